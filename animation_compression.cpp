@@ -0,0 +1,289 @@
+#include "animation_compression.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+
+    constexpr float time_range = 65535.f;
+    constexpr float value_range = 65535.f;
+
+    // Rotation components other than the largest one are within [-1/sqrt(2), 1/sqrt(2)]
+    constexpr float smallest_three_range = 0.70710678f;
+    constexpr float smallest_three_steps = (1 << 15) - 1;
+
+    std::uint16_t quantize(float value, float range)
+    {
+        return static_cast<std::uint16_t>(std::lround(std::clamp(value, 0.f, 1.f) * range));
+    }
+
+    compressed_animation::packed_vec3 pack(glm::vec3 const & value, glm::vec3 const & min, glm::vec3 const & extent)
+    {
+        compressed_animation::packed_vec3 result;
+        for (int i = 0; i < 3; ++i)
+            result[i] = extent[i] > 0.f ? quantize((value[i] - min[i]) / extent[i], value_range) : 0;
+        return result;
+    }
+
+    glm::vec3 unpack(compressed_animation::packed_vec3 const & value, glm::vec3 const & min, glm::vec3 const & extent)
+    {
+        return min + extent * glm::vec3(value[0], value[1], value[2]) / value_range;
+    }
+
+    compressed_animation::packed_quat pack(glm::quat const & value)
+    {
+        float components[4] = {value.x, value.y, value.z, value.w};
+
+        int largest = 0;
+        for (int i = 1; i < 4; ++i)
+            if (std::abs(components[i]) > std::abs(components[largest]))
+                largest = i;
+        float sign = components[largest] < 0.f ? -1.f : 1.f;
+
+        std::uint64_t bits = largest;
+        for (int i = 0; i < 4; ++i) {
+            if (i == largest)
+                continue;
+            float unit = std::clamp(sign * components[i] / smallest_three_range, -1.f, 1.f) * 0.5f + 0.5f;
+            bits = (bits << 15) | static_cast<std::uint64_t>(std::lround(unit * smallest_three_steps));
+        }
+        bits <<= 1;
+
+        return {static_cast<std::uint16_t>(bits >> 32), static_cast<std::uint16_t>(bits >> 16), static_cast<std::uint16_t>(bits)};
+    }
+
+    glm::quat unpack(compressed_animation::packed_quat const & value)
+    {
+        std::uint64_t bits = (std::uint64_t(value[0]) << 32) | (std::uint64_t(value[1]) << 16) | value[2];
+        bits >>= 1;
+
+        int largest = bits >> 45;
+        float components[4];
+        float sum = 0.f;
+        int shift = 30;
+        for (int i = 0; i < 4; ++i) {
+            if (i == largest)
+                continue;
+            float unit = ((bits >> shift) & 0x7fff) / smallest_three_steps;
+            components[i] = (unit * 2.f - 1.f) * smallest_three_range;
+            sum += components[i] * components[i];
+            shift -= 15;
+        }
+        components[largest] = std::sqrt(std::max(0.f, 1.f - sum));
+
+        return glm::normalize(glm::quat(components[3], components[0], components[1], components[2]));
+    }
+
+    float key_time(float time, float max_time)
+    {
+        return max_time > 0.f ? time / max_time * time_range : 0.f;
+    }
+
+    std::uint16_t quantize_time(float time, float max_time)
+    {
+        return quantize(key_time(time, max_time) / time_range, time_range);
+    }
+
+    // Interpolates between the keys around `time` the way gltf_model::spline does, holding the last key outside them
+    template <typename Values, typename Decode, typename Interpolate>
+    auto sample(std::vector<std::uint16_t> const & times, Values const & values, float time, std::size_t & cursor,
+        Decode decode, Interpolate interpolate)
+    {
+        auto i = find_keyframe(std::span<std::uint16_t const>(times), time, cursor);
+        if (i == 0 || i == times.size())
+            return decode(values.back());
+
+        float t = (time - times[i - 1]) / (times[i] - times[i - 1]);
+        return interpolate(decode(values[i - 1]), decode(values[i]), t);
+    }
+
+    // Greedily drops keys that the neighbouring kept keys reproduce within `tolerance`. `decoded` are the keys
+    // after quantization, so the bound holds for what is actually sampled. Returns indices of the kept keys.
+    template <typename T, typename Interpolate, typename Error>
+    std::vector<std::size_t> reduce_keys(std::vector<std::uint16_t> const & times, std::vector<T> const & source,
+        std::vector<T> const & decoded, float tolerance, Interpolate interpolate, Error error)
+    {
+        std::size_t const count = source.size();
+
+        // A single key is held for the whole animation
+        bool constant = true;
+        for (std::size_t k = 0; k < count && constant; ++k)
+            constant = error(decoded.back(), source[k]) <= tolerance;
+        if (constant)
+            return {count - 1};
+
+        auto fits = [&](std::size_t first, std::size_t last)
+        {
+            for (std::size_t k = first + 1; k < last; ++k) {
+                float span = times[last] - times[first];
+                float t = span > 0.f ? (times[k] - times[first]) / span : 0.f;
+                if (error(interpolate(decoded[first], decoded[last], t), source[k]) > tolerance)
+                    return false;
+            }
+            return true;
+        };
+
+        std::vector<std::size_t> kept{0};
+        for (std::size_t first = 0; first + 1 < count;) {
+            auto last = first + 1;
+            while (last + 1 < count && fits(first, last + 1))
+                ++last;
+            kept.push_back(last);
+            first = last;
+        }
+        return kept;
+    }
+
+    // Tracks holding `identity` within `tolerance` throughout are dropped, as empty tracks sample as identity
+    compressed_animation::vec3_track compress(gltf_model::spline<glm::vec3> const & spline, float max_time, float tolerance,
+        glm::vec3 const & identity)
+    {
+        compressed_animation::vec3_track result;
+        if (std::all_of(spline.values.begin(), spline.values.end(),
+            [&](glm::vec3 const & value){ return glm::length(value - identity) <= tolerance; }))
+            return result;
+
+        std::vector<glm::vec3> source(spline.values.begin(), spline.values.end());
+        glm::vec3 max = source[0];
+        result.min = source[0];
+        for (auto const & value : source) {
+            result.min = glm::min(result.min, value);
+            max = glm::max(max, value);
+        }
+        result.extent = max - result.min;
+
+        std::vector<std::uint16_t> times(source.size());
+        std::vector<compressed_animation::packed_vec3> packed(source.size());
+        std::vector<glm::vec3> decoded(source.size());
+        for (std::size_t k = 0; k < source.size(); ++k) {
+            times[k] = quantize_time(spline.timestamps[k], max_time);
+            packed[k] = pack(source[k], result.min, result.extent);
+            decoded[k] = unpack(packed[k], result.min, result.extent);
+        }
+
+        auto kept = reduce_keys(times, source, decoded, tolerance,
+            [](glm::vec3 const & a, glm::vec3 const & b, float t){ return glm::lerp(a, b, t); },
+            [](glm::vec3 const & a, glm::vec3 const & b){ return glm::length(a - b); });
+        for (auto k : kept) {
+            result.times.push_back(times[k]);
+            result.values.push_back(packed[k]);
+        }
+        return result;
+    }
+
+    compressed_animation::quat_track compress(gltf_model::spline<glm::quat> const & spline, float max_time, float tolerance)
+    {
+        compressed_animation::quat_track result;
+        if (std::all_of(spline.values.begin(), spline.values.end(),
+            [&](glm::vec4 const & value){ return 2.f * std::acos(std::min(1.f, std::abs(value.w) / glm::length(value))) <= tolerance; }))
+            return result;
+
+        std::vector<std::uint16_t> times(spline.values.size());
+        std::vector<glm::quat> source(spline.values.size());
+        std::vector<compressed_animation::packed_quat> packed(spline.values.size());
+        std::vector<glm::quat> decoded(spline.values.size());
+        for (std::size_t k = 0; k < source.size(); ++k) {
+            auto const & v = spline.values[k];
+            times[k] = quantize_time(spline.timestamps[k], max_time);
+            source[k] = glm::normalize(glm::quat(v.w, v.x, v.y, v.z));
+            packed[k] = pack(source[k]);
+            decoded[k] = unpack(packed[k]);
+        }
+
+        auto kept = reduce_keys(times, source, decoded, tolerance,
+            [](glm::quat const & a, glm::quat const & b, float t){ return glm::slerp(a, b, t); },
+            [](glm::quat const & a, glm::quat const & b){ return 2.f * std::acos(std::min(1.f, std::abs(glm::dot(a, b)))); });
+        for (auto k : kept) {
+            result.times.push_back(times[k]);
+            result.values.push_back(packed[k]);
+        }
+        return result;
+    }
+
+    std::size_t track_size(compressed_animation::vec3_track const & track)
+    {
+        if (track.values.empty())
+            return 0;
+        return track.times.size() * sizeof(track.times[0]) + track.values.size() * sizeof(track.values[0])
+            + sizeof(track.min) + sizeof(track.extent);
+    }
+
+    std::size_t track_size(compressed_animation::quat_track const & track)
+    {
+        return track.times.size() * sizeof(track.times[0]) + track.values.size() * sizeof(track.values[0]);
+    }
+
+    template <typename T>
+    std::size_t spline_size(gltf_model::spline<T> const & spline)
+    {
+        return spline.timestamps.size_bytes() + spline.values.size_bytes();
+    }
+
+}
+
+glm::vec3 compressed_animation::translation(std::size_t bone, float time, std::size_t & cursor) const
+{
+    auto const & track = bones[bone].translation;
+    if (track.values.empty())
+        return glm::vec3(0.f);
+
+    return sample(track.times, track.values, key_time(time, max_time), cursor,
+        [&](packed_vec3 const & value){ return unpack(value, track.min, track.extent); },
+        [](glm::vec3 const & a, glm::vec3 const & b, float t){ return glm::lerp(a, b, t); });
+}
+
+glm::quat compressed_animation::rotation(std::size_t bone, float time, std::size_t & cursor) const
+{
+    auto const & track = bones[bone].rotation;
+    if (track.values.empty())
+        return {1.f, 0.f, 0.f, 0.f};
+
+    return sample(track.times, track.values, key_time(time, max_time), cursor,
+        [](packed_quat const & value){ return unpack(value); },
+        [](glm::quat const & a, glm::quat const & b, float t){ return glm::slerp(a, b, t); });
+}
+
+glm::vec3 compressed_animation::scale(std::size_t bone, float time, std::size_t & cursor) const
+{
+    auto const & track = bones[bone].scale;
+    if (track.values.empty())
+        return glm::vec3(1.f);
+
+    return sample(track.times, track.values, key_time(time, max_time), cursor,
+        [&](packed_vec3 const & value){ return unpack(value, track.min, track.extent); },
+        [](glm::vec3 const & a, glm::vec3 const & b, float t){ return glm::lerp(a, b, t); });
+}
+
+std::size_t compressed_animation::memory_size() const
+{
+    std::size_t result = 0;
+    for (auto const & bone : bones)
+        result += track_size(bone.translation) + track_size(bone.rotation) + track_size(bone.scale);
+    return result;
+}
+
+compressed_animation compress_animation(gltf_model::animation const & animation, animation_compression_settings const & settings)
+{
+    compressed_animation result;
+    result.max_time = animation.max_time;
+    result.bones.reserve(animation.bones.size());
+
+    for (auto const & bone : animation.bones) {
+        result.bones.push_back({
+            compress(bone.translation, animation.max_time, settings.translation_error, glm::vec3(0.f)),
+            compress(bone.rotation, animation.max_time, settings.rotation_error),
+            compress(bone.scale, animation.max_time, settings.scale_error, glm::vec3(1.f)),
+        });
+    }
+
+    return result;
+}
+
+std::size_t animation_memory_size(gltf_model::animation const & animation)
+{
+    std::size_t result = 0;
+    for (auto const & bone : animation.bones)
+        result += spline_size(bone.translation) + spline_size(bone.rotation) + spline_size(bone.scale);
+    return result;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "gltf_loader.hpp"
+
+#include <glm/vec3.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Error bounds of compress_animation: a compressed track never deviates from the source keys by more than these
+struct animation_compression_settings
+{
+    // Model units
+    float translation_error = 1e-3f;
+    // Radians
+    float rotation_error = 1e-3f;
+    float scale_error = 1e-3f;
+};
+
+// An animation with redundant keys removed and the rest quantized: key times to 16 bits of the animation
+// length, translations and scales to 16 bits per component over the track's range, rotations to 48 bits
+// (smallest three). Tracks are decompressed on sample, and sample like gltf_model::spline does.
+struct compressed_animation
+{
+    using packed_vec3 = std::array<std::uint16_t, 3>;
+    // Index of the dropped largest component in the top two bits, the other three in 15 bits each
+    using packed_quat = std::array<std::uint16_t, 3>;
+
+    struct vec3_track
+    {
+        std::vector<std::uint16_t> times;
+        std::vector<packed_vec3> values;
+        glm::vec3 min{0.f};
+        glm::vec3 extent{0.f};
+    };
+
+    struct quat_track
+    {
+        std::vector<std::uint16_t> times;
+        std::vector<packed_quat> values;
+    };
+
+    struct bone_animation
+    {
+        vec3_track translation;
+        quat_track rotation;
+        vec3_track scale;
+    };
+
+    std::vector<bone_animation> bones;
+    float max_time = 0.f;
+
+    // Untouched channels sample as identity; `cursor` works like with gltf_model::spline
+    glm::vec3 translation(std::size_t bone, float time, std::size_t & cursor) const;
+    glm::quat rotation(std::size_t bone, float time, std::size_t & cursor) const;
+    glm::vec3 scale(std::size_t bone, float time, std::size_t & cursor) const;
+
+    std::size_t memory_size() const;
+};
+
+compressed_animation compress_animation(gltf_model::animation const & animation,
+    animation_compression_settings const & settings = {});
+
+// Bytes taken by the keys of an uncompressed animation
+std::size_t animation_memory_size(gltf_model::animation const & animation);
@@ -0,0 +1,204 @@
+#include "animation_graph.hpp"
+
+#include <glm/gtx/quaternion.hpp>
+#include <glm/gtx/compatibility.hpp>
+
+#include <numeric>
+#include <stdexcept>
+
+local_pose::local_pose(std::size_t bone_count)
+    : translations(bone_count, glm::vec3(0.f))
+    , rotations(bone_count, glm::quat(1.f, 0.f, 0.f, 0.f))
+    , scales(bone_count, glm::vec3(1.f))
+{}
+
+animation_graph::animation_graph(std::size_t bone_count)
+    : bone_count(bone_count)
+    , all_bones(bone_count)
+{
+    std::iota(all_bones.begin(), all_bones.end(), std::size_t(0));
+}
+
+animation_graph::node_id animation_graph::add_node(node && value)
+{
+    for (auto input : value.inputs)
+        if (input >= nodes.size())
+            throw std::runtime_error("Animation graph node added before its input");
+    if (!value.bone_mask.empty() && value.bone_mask.size() != bone_count)
+        throw std::runtime_error("Animation graph bone mask doesn't match the skeleton");
+
+    value.pose = local_pose(bone_count);
+    nodes.push_back(std::move(value));
+    return nodes.size() - 1;
+}
+
+animation_graph::node_id animation_graph::add_clip(sampler sample)
+{
+    return add_node({.type = node_type::clip, .sample = std::move(sample)});
+}
+
+animation_graph::node_id animation_graph::add_blend(std::vector<node_id> inputs)
+{
+    std::vector<float> weights(inputs.size(), 0.f);
+    return add_node({.type = node_type::blend, .inputs = std::move(inputs), .weights = std::move(weights)});
+}
+
+animation_graph::node_id animation_graph::add_layer(node_id base, node_id layer, std::vector<float> bone_mask)
+{
+    return add_node({.type = node_type::layer, .inputs = {base, layer}, .weights = {0.f}, .bone_mask = std::move(bone_mask)});
+}
+
+animation_graph::node_id animation_graph::add_additive(node_id base, node_id additive, node_id reference, std::vector<float> bone_mask)
+{
+    return add_node({.type = node_type::additive, .inputs = {base, additive, reference}, .weights = {0.f}, .bone_mask = std::move(bone_mask)});
+}
+
+void animation_graph::set_time(node_id clip, float time)
+{
+    nodes[clip].time = time;
+}
+
+void animation_graph::set_weight(node_id blend, std::size_t input, float weight)
+{
+    nodes[blend].weights[input] = weight;
+}
+
+void animation_graph::set_weight(node_id layer_or_additive, float weight)
+{
+    nodes[layer_or_additive].weights[0] = weight;
+}
+
+float animation_graph::bone_weight(node const & value, std::size_t bone) const
+{
+    return value.bone_mask.empty() ? value.weights[0] : value.weights[0] * value.bone_mask[bone];
+}
+
+local_pose const & animation_graph::evaluate(node_id root)
+{
+    return evaluate(root, all_bones);
+}
+
+local_pose const & animation_graph::evaluate(node_id root, std::span<std::size_t const> bones)
+{
+    this->bones = bones;
+    auto & pose = nodes[root].pose;
+    evaluate_node(root, pose);
+    return pose;
+}
+
+void animation_graph::evaluate_node(node_id id, local_pose & pose)
+{
+    auto & current = nodes[id];
+
+    switch (current.type) {
+    case node_type::clip:
+        current.sample(current.time, bones, pose);
+        break;
+
+    case node_type::blend: {
+        float total = 0.f;
+        std::size_t active = 0, first_active = 0, last_active = 0;
+        for (std::size_t i = 0; i < current.inputs.size(); ++i) {
+            if (current.weights[i] > 0.f) {
+                total += current.weights[i];
+                if (active++ == 0)
+                    first_active = i;
+                last_active = i;
+            }
+        }
+
+        if (active <= 1) {
+            evaluate_node(current.inputs[last_active], pose);
+            break;
+        }
+
+        // Two inputs are slerped like a transition, more are nlerped with each rotation flipped into the
+        // hemisphere of the sum so far
+        if (active == 2) {
+            evaluate_node(current.inputs[first_active], pose);
+            auto & input = nodes[current.inputs[last_active]].pose;
+            evaluate_node(current.inputs[last_active], input);
+            float weight = current.weights[last_active] / total;
+            for (auto bone : bones) {
+                pose.translations[bone] = glm::lerp(pose.translations[bone], input.translations[bone], weight);
+                pose.rotations[bone] = glm::slerp(pose.rotations[bone], input.rotations[bone], weight);
+                pose.scales[bone] = glm::lerp(pose.scales[bone], input.scales[bone], weight);
+            }
+            break;
+        }
+
+        bool first = true;
+        for (std::size_t i = 0; i < current.inputs.size(); ++i) {
+            if (current.weights[i] <= 0.f)
+                continue;
+
+            auto & input = nodes[current.inputs[i]].pose;
+            evaluate_node(current.inputs[i], input);
+            float weight = current.weights[i] / total;
+            for (auto bone : bones) {
+                if (first) {
+                    pose.translations[bone] = input.translations[bone] * weight;
+                    pose.rotations[bone] = input.rotations[bone] * weight;
+                    pose.scales[bone] = input.scales[bone] * weight;
+                } else {
+                    float sign = glm::dot(pose.rotations[bone], input.rotations[bone]) < 0.f ? -1.f : 1.f;
+                    pose.translations[bone] += input.translations[bone] * weight;
+                    pose.rotations[bone] = pose.rotations[bone] + input.rotations[bone] * (weight * sign);
+                    pose.scales[bone] += input.scales[bone] * weight;
+                }
+            }
+            first = false;
+        }
+
+        for (auto bone : bones)
+            pose.rotations[bone] = glm::normalize(pose.rotations[bone]);
+        break;
+    }
+
+    case node_type::layer: {
+        evaluate_node(current.inputs[0], pose);
+        if (current.weights[0] <= 0.f)
+            break;
+
+        auto & layer = nodes[current.inputs[1]].pose;
+        evaluate_node(current.inputs[1], layer);
+        for (auto bone : bones) {
+            float weight = bone_weight(current, bone);
+            pose.translations[bone] = glm::lerp(pose.translations[bone], layer.translations[bone], weight);
+            pose.rotations[bone] = glm::slerp(pose.rotations[bone], layer.rotations[bone], weight);
+            pose.scales[bone] = glm::lerp(pose.scales[bone], layer.scales[bone], weight);
+        }
+        break;
+    }
+
+    case node_type::additive: {
+        evaluate_node(current.inputs[0], pose);
+        if (current.weights[0] <= 0.f)
+            break;
+
+        auto & additive = nodes[current.inputs[1]].pose;
+        evaluate_node(current.inputs[1], additive);
+        auto & reference = nodes[current.inputs[2]].pose;
+        evaluate_node(current.inputs[2], reference);
+        glm::quat const identity(1.f, 0.f, 0.f, 0.f);
+        for (auto bone : bones) {
+            float weight = bone_weight(current, bone);
+            auto rotation = glm::inverse(reference.rotations[bone]) * additive.rotations[bone];
+            pose.translations[bone] += (additive.translations[bone] - reference.translations[bone]) * weight;
+            pose.rotations[bone] = glm::normalize(pose.rotations[bone] * glm::slerp(identity, rotation, weight));
+            pose.scales[bone] *= glm::lerp(glm::vec3(1.f), additive.scales[bone] / reference.scales[bone], weight);
+        }
+        break;
+    }
+    }
+}
+
+void sample_animation(gltf_model::animation const & animation, float time, local_pose & pose)
+{
+    for (std::size_t i = 0; i < animation.bones.size(); ++i) {
+        auto const & bone = animation.bones[i];
+        pose.translations[i] = bone.translation.values.empty() ? glm::vec3(0.f) : bone.translation(time);
+        pose.rotations[i] = bone.rotation.values.empty() ? glm::quat(1.f, 0.f, 0.f, 0.f) : bone.rotation(time);
+        pose.scales[i] = bone.scale.values.empty() ? glm::vec3(1.f) : bone.scale(time);
+    }
+}
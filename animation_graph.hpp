@@ -0,0 +1,87 @@
+#pragma once
+
+#include "gltf_loader.hpp"
+
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cstddef>
+#include <functional>
+#include <span>
+#include <vector>
+
+// Local (parent-relative) transforms of every bone of a skeleton
+struct local_pose
+{
+    explicit local_pose(std::size_t bone_count = 0);
+
+    std::vector<glm::vec3> translations;
+    std::vector<glm::quat> rotations;
+    std::vector<glm::vec3> scales;
+};
+
+// A tree of poses blended in local space: clips sample animations, blend nodes mix any number of inputs,
+// layer nodes override a base pose and additive nodes add the difference of two poses on top of it, both
+// optionally per bone. Every node owns a pose allocated when it is added, and inputs with zero weight are
+// not evaluated, so evaluation costs one pass per active node and allocates nothing. Evaluation may be
+// limited to some of the bones, see skeleton_lod.
+struct animation_graph
+{
+    using node_id = std::size_t;
+    // Writes `bones` of the pose at `time` into `pose`, which has the graph's bone count
+    using sampler = std::function<void(float time, std::span<std::size_t const> bones, local_pose & pose)>;
+
+    explicit animation_graph(std::size_t bone_count);
+
+    // Nodes must be added after their inputs
+    node_id add_clip(sampler sample);
+    node_id add_blend(std::vector<node_id> inputs);
+    // `bone_mask` scales the weight per bone, empty means all bones at full weight
+    node_id add_layer(node_id base, node_id layer, std::vector<float> bone_mask = {});
+    // Adds `additive` relative to `reference` on top of `base`
+    node_id add_additive(node_id base, node_id additive, node_id reference, std::vector<float> bone_mask = {});
+
+    void set_time(node_id clip, float time);
+    void set_weight(node_id blend, std::size_t input, float weight);
+    void set_weight(node_id layer_or_additive, float weight);
+
+    local_pose const & evaluate(node_id root);
+    // Only `bones` of the result are evaluated, the others hold whatever earlier evaluations left there
+    local_pose const & evaluate(node_id root, std::span<std::size_t const> bones);
+
+private:
+    enum class node_type
+    {
+        clip,
+        blend,
+        layer,
+        additive,
+    };
+
+    struct node
+    {
+        node_type type;
+        sampler sample;
+        float time = 0.f;
+        std::vector<node_id> inputs;
+        std::vector<float> weights;
+        std::vector<float> bone_mask;
+        local_pose pose = local_pose(0);
+    };
+
+    node_id add_node(node && value);
+    float bone_weight(node const & value, std::size_t bone) const;
+    // Writes the bones of the evaluation in progress into `pose`, either the caller's output or the node's own
+    // pose when the caller needs it next to another
+    void evaluate_node(node_id id, local_pose & pose);
+
+    std::size_t bone_count;
+    std::vector<node> nodes;
+    std::vector<std::size_t> all_bones;
+    // Bones of the evaluation in progress
+    std::span<std::size_t const> bones;
+};
+
+// Samples every bone of `animation` at `time`; channels the animation doesn't have are identity
+void sample_animation(gltf_model::animation const & animation, float time, local_pose & pose);
@@ -0,0 +1,27 @@
+#include "scene_pack.hpp"
+
+#include <chrono>
+#include <iostream>
+
+int main(int argc, char ** argv) try
+{
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <scene.gltf|scene.glb> [output.pack]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::filesystem::path const source_path = argv[1];
+    std::filesystem::path const pack_path = (argc > 2) ? std::filesystem::path(argv[2]) : scene_pack_path(source_path);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    save_scene_pack(bake_scene(source_path), source_path, pack_path);
+
+    std::cout << "Baked " << pack_path.string() << " (" << std::filesystem::file_size(pack_path) << " bytes) in "
+              << std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count()
+              << " ms" << std::endl;
+}
+catch (std::exception const & e)
+{
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+}
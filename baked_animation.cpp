@@ -0,0 +1,168 @@
+#include "baked_animation.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define BAKED_ANIMATION_SSE
+#endif
+
+namespace
+{
+
+    constexpr std::size_t simd_width = 4;
+
+    enum channel : std::size_t
+    {
+        translation_x, translation_y, translation_z,
+        rotation_x, rotation_y, rotation_z, rotation_w,
+        scale_x, scale_y, scale_z,
+        channel_count,
+    };
+
+    void lerp(float const * a, float const * b, float t, float * result, std::size_t count)
+    {
+#ifdef BAKED_ANIMATION_SSE
+        auto const tt = _mm_set1_ps(t);
+        for (std::size_t i = 0; i < count; i += simd_width) {
+            auto const va = _mm_loadu_ps(a + i);
+            auto const vb = _mm_loadu_ps(b + i);
+            _mm_storeu_ps(result + i, _mm_add_ps(va, _mm_mul_ps(_mm_sub_ps(vb, va), tt)));
+        }
+#else
+        for (std::size_t i = 0; i < count; ++i)
+            result[i] = a[i] + (b[i] - a[i]) * t;
+#endif
+    }
+
+    void normalize_rotations(float * values, std::size_t bone_stride)
+    {
+        float * x = values + rotation_x * bone_stride;
+        float * y = values + rotation_y * bone_stride;
+        float * z = values + rotation_z * bone_stride;
+        float * w = values + rotation_w * bone_stride;
+
+#ifdef BAKED_ANIMATION_SSE
+        for (std::size_t i = 0; i < bone_stride; i += simd_width) {
+            auto const vx = _mm_loadu_ps(x + i);
+            auto const vy = _mm_loadu_ps(y + i);
+            auto const vz = _mm_loadu_ps(z + i);
+            auto const vw = _mm_loadu_ps(w + i);
+            auto length = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)),
+                _mm_add_ps(_mm_mul_ps(vz, vz), _mm_mul_ps(vw, vw)));
+            auto const inverse = _mm_div_ps(_mm_set1_ps(1.f), _mm_sqrt_ps(length));
+            _mm_storeu_ps(x + i, _mm_mul_ps(vx, inverse));
+            _mm_storeu_ps(y + i, _mm_mul_ps(vy, inverse));
+            _mm_storeu_ps(z + i, _mm_mul_ps(vz, inverse));
+            _mm_storeu_ps(w + i, _mm_mul_ps(vw, inverse));
+        }
+#else
+        for (std::size_t i = 0; i < bone_stride; ++i) {
+            float inverse = 1.f / std::sqrt(x[i] * x[i] + y[i] * y[i] + z[i] * z[i] + w[i] * w[i]);
+            x[i] *= inverse;
+            y[i] *= inverse;
+            z[i] *= inverse;
+            w[i] *= inverse;
+        }
+#endif
+    }
+
+}
+
+glm::vec3 baked_animation::pose::translation(std::size_t bone) const
+{
+    auto const * v = values.data() + bone;
+    return {v[translation_x * bone_stride], v[translation_y * bone_stride], v[translation_z * bone_stride]};
+}
+
+glm::quat baked_animation::pose::rotation(std::size_t bone) const
+{
+    auto const * v = values.data() + bone;
+    return {v[rotation_w * bone_stride], v[rotation_x * bone_stride], v[rotation_y * bone_stride], v[rotation_z * bone_stride]};
+}
+
+glm::vec3 baked_animation::pose::scale(std::size_t bone) const
+{
+    auto const * v = values.data() + bone;
+    return {v[scale_x * bone_stride], v[scale_y * bone_stride], v[scale_z * bone_stride]};
+}
+
+void baked_animation::sample(float time, pose & result) const
+{
+    std::size_t const frame_size = channel_count * bone_stride;
+    result.bone_stride = bone_stride;
+    result.values.resize(frame_size);
+
+    time = std::clamp(time, 0.f, duration);
+    auto first = std::min<std::size_t>(time * frame_rate, frame_count - 1);
+    auto second = std::min(first + 1, frame_count - 1);
+
+    // The last frame sits at `duration`, which is usually closer than a whole frame to the previous one
+    float first_time = first / frame_rate;
+    float second_time = std::min(second / frame_rate, duration);
+    float t = second_time > first_time ? (time - first_time) / (second_time - first_time) : 0.f;
+
+    lerp(frames.data() + first * frame_size, frames.data() + second * frame_size, t, result.values.data(), frame_size);
+    normalize_rotations(result.values.data(), bone_stride);
+}
+
+baked_animation bake_animation(gltf_model::animation const & animation, float frame_rate)
+{
+    baked_animation result;
+    result.frame_rate = frame_rate;
+    result.duration = animation.max_time;
+    result.bone_count = animation.bones.size();
+    result.bone_stride = (result.bone_count + simd_width - 1) / simd_width * simd_width;
+    result.frame_count = static_cast<std::size_t>(std::ceil(animation.max_time * frame_rate)) + 1;
+
+    std::size_t const frame_size = channel_count * result.bone_stride;
+    result.frames.resize(result.frame_count * frame_size);
+
+    std::vector<gltf_model::bone_cursor> cursors(result.bone_count);
+
+    for (std::size_t frame = 0; frame < result.frame_count; ++frame) {
+        float time = std::min(frame / frame_rate, animation.max_time);
+        float * values = result.frames.data() + frame * frame_size;
+        auto store = [&](std::size_t channel, std::size_t bone, float value){ values[channel * result.bone_stride + bone] = value; };
+
+        for (std::size_t bone = 0; bone < result.bone_stride; ++bone) {
+            glm::vec3 translation(0.f);
+            glm::quat rotation(1.f, 0.f, 0.f, 0.f);
+            glm::vec3 scale(1.f);
+
+            if (bone < result.bone_count) {
+                auto const & channels = animation.bones[bone];
+                auto & cursor = cursors[bone];
+                if (!channels.translation.values.empty())
+                    translation = channels.translation(time, cursor.translation);
+                if (!channels.rotation.values.empty())
+                    rotation = channels.rotation(time, cursor.rotation);
+                if (!channels.scale.values.empty())
+                    scale = channels.scale(time, cursor.scale);
+
+                // Keep neighbouring frames in the same hemisphere so that nlerp takes the short way
+                if (frame > 0) {
+                    float const * previous = values - frame_size + bone;
+                    glm::quat previous_rotation(previous[rotation_w * result.bone_stride], previous[rotation_x * result.bone_stride],
+                        previous[rotation_y * result.bone_stride], previous[rotation_z * result.bone_stride]);
+                    if (glm::dot(rotation, previous_rotation) < 0.f)
+                        rotation = -rotation;
+                }
+            }
+
+            store(translation_x, bone, translation.x);
+            store(translation_y, bone, translation.y);
+            store(translation_z, bone, translation.z);
+            store(rotation_x, bone, rotation.x);
+            store(rotation_y, bone, rotation.y);
+            store(rotation_z, bone, rotation.z);
+            store(rotation_w, bone, rotation.w);
+            store(scale_x, bone, scale.x);
+            store(scale_y, bone, scale.y);
+            store(scale_z, bone, scale.z);
+        }
+    }
+
+    return result;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "gltf_loader.hpp"
+
+#include <glm/vec3.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cstddef>
+#include <vector>
+
+// An animation resampled at a fixed frame rate. Each frame stores the pose of all bones structure-of-arrays
+// (translation x for every bone, then y, z, rotation x, y, z, w, scale x, y, z), so a pose is evaluated by
+// lerping two contiguous blocks of floats four bones at a time instead of searching every bone's splines.
+struct baked_animation
+{
+    // Evaluated pose, laid out like a frame
+    struct pose
+    {
+        glm::vec3 translation(std::size_t bone) const;
+        glm::quat rotation(std::size_t bone) const;
+        glm::vec3 scale(std::size_t bone) const;
+
+        std::size_t bone_stride = 0;
+        std::vector<float> values;
+    };
+
+    float frame_rate = 0.f;
+    float duration = 0.f;
+    std::size_t bone_count = 0;
+    // Bone count rounded up to the SIMD width
+    std::size_t bone_stride = 0;
+    std::size_t frame_count = 0;
+    std::vector<float> frames;
+
+    // Times outside [0, duration] are clamped; callers wrap looping animations themselves.
+    // Rotations between frames are nlerped, `result` is resized on first use only.
+    void sample(float time, pose & result) const;
+};
+
+baked_animation bake_animation(gltf_model::animation const & animation, float frame_rate);
@@ -0,0 +1,120 @@
+#include "bone_palette.hpp"
+
+#include <glm/mat3x3.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+static_assert(sizeof(glm::mat4x3) == 3 * sizeof(glm::vec4));
+
+std::array<glm::vec4, 2> dual_quaternion_texels(glm::mat4x3 const & bone)
+{
+    // Columns are normalized first, as a dual quaternion can't hold scale
+    glm::mat3 rotation(glm::normalize(bone[0]), glm::normalize(bone[1]), glm::normalize(bone[2]));
+    glm::dualquat const result(glm::normalize(glm::quat_cast(rotation)), bone[3]);
+    // Written component by component, as glm stores quaternions scalar first unless GLM_FORCE_QUAT_DATA_XYZW
+    return {
+        glm::vec4(result.real.x, result.real.y, result.real.z, result.real.w),
+        glm::vec4(result.dual.x, result.dual.y, result.dual.z, result.dual.w),
+    };
+}
+
+bone_palette_ring::bone_palette_ring(std::size_t frame_capacity, skinning_mode mode)
+    : mode(mode)
+    , frame_capacity(frame_capacity * texels_per_bone())
+{
+    // GL 3.3 only guarantees 65536 texels, shared by all regions of the ring
+    GLint max_texels = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &max_texels);
+    auto const max_frame_bones = static_cast<std::size_t>(max_texels) / frames_in_flight / texels_per_bone();
+    if (max_frame_bones == 0)
+        throw std::runtime_error("Texture buffers are too small for bone palettes");
+    this->frame_capacity = std::min(this->frame_capacity, max_frame_bones * texels_per_bone());
+
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+    glBufferData(GL_TEXTURE_BUFFER, frames_in_flight * this->frame_capacity * sizeof(glm::vec4), nullptr, GL_STREAM_DRAW);
+
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_BUFFER, texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buffer);
+}
+
+bone_palette_ring::~bone_palette_ring()
+{
+    for (auto fence : fences)
+        if (fence)
+            glDeleteSync(fence);
+    glDeleteTextures(1, &texture);
+    glDeleteBuffers(1, &buffer);
+}
+
+void bone_palette_ring::begin_frame()
+{
+    region = (region + 1) % frames_in_flight;
+    used = 0;
+
+    if (auto & fence = fences[region]) {
+        glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+}
+
+std::size_t bone_palette_ring::write(std::span<glm::mat4x3 const> bones)
+{
+    if (mode == skinning_mode::linear)
+        return write_texels({reinterpret_cast<glm::vec4 const *>(bones.data()), bones.size() * 3});
+
+    dual_quaternion_palette.resize(bones.size() * 2);
+    for (std::size_t i = 0; i < bones.size(); ++i) {
+        auto const texels = dual_quaternion_texels(bones[i]);
+        dual_quaternion_palette[2 * i] = texels[0];
+        dual_quaternion_palette[2 * i + 1] = texels[1];
+    }
+    return write_texels(dual_quaternion_palette);
+}
+
+std::size_t bone_palette_ring::write_texels(std::span<glm::vec4 const> texels)
+{
+    if (used + texels.size() > frame_capacity)
+        throw std::runtime_error("Bone palettes of a frame exceed the ring capacity");
+
+    auto const offset = region * frame_capacity + used;
+    used += texels.size();
+    if (texels.empty())
+        return offset;
+
+    // The region isn't read by any draw in flight, so there is nothing to synchronize with
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+    auto destination = glMapBufferRange(GL_TEXTURE_BUFFER, offset * sizeof(glm::vec4), texels.size_bytes(),
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    std::memcpy(destination, texels.data(), texels.size_bytes());
+    glUnmapBuffer(GL_TEXTURE_BUFFER);
+
+    return offset;
+}
+
+void bone_palette_ring::end_frame()
+{
+    fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void bone_palette_ring::bind(GLenum texture_unit) const
+{
+    glActiveTexture(texture_unit);
+    glBindTexture(GL_TEXTURE_BUFFER, texture);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+std::size_t bone_palette_ring::texels_per_bone() const
+{
+    return mode == skinning_mode::linear ? 3 : 2;
+}
+
+std::size_t bone_palette_ring::capacity() const
+{
+    return frame_capacity / texels_per_bone();
+}
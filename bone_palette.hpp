@@ -0,0 +1,70 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <glm/vec4.hpp>
+#include <glm/mat4x3.hpp>
+#include <glm/gtx/dual_quaternion.hpp>
+
+#include <array>
+#include <cstddef>
+#include <span>
+#include <vector>
+
+enum class skinning_mode
+{
+    // Matrices blended linearly, three texels per bone
+    linear,
+    // Rigid transforms blended as dual quaternions, two texels per bone; no candy-wrapper collapse on twisting
+    // joints, but bone scale is dropped
+    dual_quaternion,
+};
+
+// The two texels of a bone in skinning_mode::dual_quaternion: the real and the dual part, each as (x, y, z, w)
+// with w the scalar, as the shaders read them
+std::array<glm::vec4, 2> dual_quaternion_texels(glm::mat4x3 const & bone);
+
+// Bone palettes of every skinned draw of a frame in one RGBA32F texture buffer, so palettes aren't limited by
+// uniform space. The buffer is a ring of per-frame regions guarded by fences: palettes are written once per
+// character per frame without waiting on draws of previous frames still in flight, and shaders find a palette
+// by its offset.
+struct bone_palette_ring
+{
+    static constexpr std::size_t frames_in_flight = 3;
+
+    // `frame_capacity` is the number of bones a single frame may write, lowered to what fits in a texture buffer
+    // of GL_MAX_TEXTURE_BUFFER_SIZE texels; `capacity()` tells what was kept
+    bone_palette_ring(std::size_t frame_capacity, skinning_mode mode);
+    ~bone_palette_ring();
+
+    bone_palette_ring(bone_palette_ring const &) = delete;
+    bone_palette_ring & operator = (bone_palette_ring const &) = delete;
+
+    // Moves to the next region, waiting for the GPU to finish the frame that last used it
+    void begin_frame();
+    // Writes skinning matrices in the ring's representation; returns the offset of the palette in texels,
+    // to be passed to the shader
+    std::size_t write(std::span<glm::mat4x3 const> bones);
+    // Fences the region after the frame's draws were issued
+    void end_frame();
+
+    void bind(GLenum texture_unit) const;
+
+    std::size_t texels_per_bone() const;
+    // Number of bones a single frame may write
+    std::size_t capacity() const;
+
+    skinning_mode const mode;
+
+private:
+    std::size_t write_texels(std::span<glm::vec4 const> texels);
+
+    std::size_t frame_capacity;
+    std::size_t region = 0;
+    std::size_t used = 0;
+    std::array<GLsync, frames_in_flight> fences{};
+    std::vector<glm::vec4> dual_quaternion_palette;
+
+    GLuint buffer = 0;
+    GLuint texture = 0;
+};
@@ -0,0 +1,62 @@
+// Checks that the texels bone_palette_ring writes decode, as skinning_matrix in shaders.h reads them, to the same
+// matrix in both skinning modes
+
+#include "bone_palette.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+// skinning_matrix of a vertex bound to a single joint, linear branch
+static glm::mat4x3 decode_linear(glm::vec4 a, glm::vec4 b, glm::vec4 c)
+{
+    return glm::mat4x3(glm::vec3(a.x, a.y, a.z), glm::vec3(a.w, b.x, b.y), glm::vec3(b.z, b.w, c.x), glm::vec3(c.y, c.z, c.w));
+}
+
+// skinning_matrix of a vertex bound to a single joint, dual quaternion branch
+static glm::mat4x3 decode_dual_quaternion(glm::vec4 real, glm::vec4 dual)
+{
+    float norm = glm::length(real);
+    real /= norm;
+    dual /= norm;
+
+    glm::vec3 q(real.x, real.y, real.z);
+    float w = real.w;
+    glm::vec3 d(dual.x, dual.y, dual.z);
+    glm::vec3 translation = 2.f * (w * d - dual.w * q + glm::cross(q, d));
+    return glm::mat4x3(
+        glm::vec3(1.f - 2.f * (q.y * q.y + q.z * q.z), 2.f * (q.x * q.y + w * q.z), 2.f * (q.x * q.z - w * q.y)),
+        glm::vec3(2.f * (q.x * q.y - w * q.z), 1.f - 2.f * (q.x * q.x + q.z * q.z), 2.f * (q.y * q.z + w * q.x)),
+        glm::vec3(2.f * (q.x * q.z + w * q.y), 2.f * (q.y * q.z - w * q.x), 1.f - 2.f * (q.x * q.x + q.y * q.y)),
+        translation);
+}
+
+static bool check(char const * name, glm::mat4x3 const & bone)
+{
+    // The linear texels are the matrix memory itself, as bone_palette_ring::write uploads it
+    auto const linear_texels = reinterpret_cast<glm::vec4 const *>(&bone);
+    auto const linear = decode_linear(linear_texels[0], linear_texels[1], linear_texels[2]);
+    auto const dual_quaternion_texels = ::dual_quaternion_texels(bone);
+    auto const dual_quaternion = decode_dual_quaternion(dual_quaternion_texels[0], dual_quaternion_texels[1]);
+
+    bool equal = true;
+    for (int column = 0; column < 4; ++column)
+        for (int row = 0; row < 3; ++row)
+            equal = equal && std::abs(linear[column][row] - bone[column][row]) < 1e-5f
+                && std::abs(dual_quaternion[column][row] - linear[column][row]) < 1e-5f;
+    if (!equal)
+        std::cerr << name << ": dual quaternion texels don't decode to the bone's matrix" << std::endl;
+    return equal;
+}
+
+int main()
+{
+    bool passed = true;
+    passed = check("identity", glm::mat4x3(1.f)) && passed;
+    passed = check("translated", glm::mat4x3(glm::translate(glm::mat4(1.f), glm::vec3(1.f, -2.f, 3.f)))) && passed;
+    passed = check("rotated", glm::mat4x3(glm::rotate(glm::translate(glm::mat4(1.f), glm::vec3(0.5f, 0.f, -1.f)),
+        1.f, glm::normalize(glm::vec3(1.f, 2.f, 3.f))))) && passed;
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,146 @@
+#include "cpu_skinning.hpp"
+
+#include <glm/geometric.hpp>
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define CPU_SKINNING_SSE
+#endif
+
+static_assert(sizeof(glm::mat4x3) == 12 * sizeof(float));
+
+cpu_skinned_mesh::cpu_skinned_mesh(gltf_model const & model, gltf_model::mesh const & mesh)
+    : vertex_count(mesh.position.count)
+    , positions(mesh.position.count)
+    , normals(mesh.position.count)
+    , joints(mesh.position.count)
+    , weights(mesh.position.count)
+{
+    if (!mesh.is_rigged)
+        throw std::runtime_error("CPU skinning of a mesh without a skin: " + mesh.name);
+
+    auto const source_positions = read_accessor(model, mesh.position);
+    auto const source_normals = read_accessor(model, mesh.normal);
+    auto const source_joints = read_accessor(model, mesh.joints);
+    auto const source_weights = read_accessor(model, mesh.weights);
+
+    for (std::size_t vertex = 0; vertex < vertex_count; ++vertex) {
+        positions[vertex] = glm::vec4(source_positions[vertex * 3], source_positions[vertex * 3 + 1], source_positions[vertex * 3 + 2], 1.f);
+        normals[vertex] = glm::vec4(source_normals[vertex * 3], source_normals[vertex * 3 + 1], source_normals[vertex * 3 + 2], 0.f);
+
+        float sum = 0.f;
+        for (std::size_t i = 0; i < 4; ++i) {
+            joints[vertex][i] = static_cast<std::uint32_t>(source_joints[vertex * 4 + i]);
+            weights[vertex][i] = source_weights[vertex * 4 + i];
+            sum += weights[vertex][i];
+        }
+        weights[vertex] /= sum;
+    }
+}
+
+namespace
+{
+
+// Runs `output(vertex, position, normal)` for every skinned vertex; normals are only transformed when asked for
+template <bool with_normals, typename Output>
+void skin(cpu_skinned_mesh const & mesh, std::span<glm::mat4x3 const> palette, Output && output)
+{
+    for (std::size_t vertex = 0; vertex < mesh.vertex_count; ++vertex) {
+        auto const & joints = mesh.joints[vertex];
+        auto const & weights = mesh.weights[vertex];
+#ifdef CPU_SKINNING_SSE
+        // The blended matrix is kept as its 12 floats in three registers, columns straddling them
+        __m128 m0 = _mm_setzero_ps(), m1 = _mm_setzero_ps(), m2 = _mm_setzero_ps();
+        for (std::size_t i = 0; i < 4; ++i) {
+            auto const matrix = &palette[joints[i]][0][0];
+            __m128 const weight = _mm_set1_ps(weights[i]);
+            m0 = _mm_add_ps(m0, _mm_mul_ps(weight, _mm_loadu_ps(matrix)));
+            m1 = _mm_add_ps(m1, _mm_mul_ps(weight, _mm_loadu_ps(matrix + 4)));
+            m2 = _mm_add_ps(m2, _mm_mul_ps(weight, _mm_loadu_ps(matrix + 8)));
+        }
+        __m128 const c0 = m0;
+        __m128 const c1_source = _mm_shuffle_ps(m0, m1, _MM_SHUFFLE(1, 0, 3, 3));
+        __m128 const c1 = _mm_shuffle_ps(c1_source, c1_source, _MM_SHUFFLE(3, 3, 2, 0));
+        __m128 const c2 = _mm_shuffle_ps(m1, m2, _MM_SHUFFLE(0, 0, 3, 2));
+        __m128 const c3 = _mm_shuffle_ps(m2, m2, _MM_SHUFFLE(3, 3, 2, 1));
+
+        __m128 const p = _mm_loadu_ps(&mesh.positions[vertex].x);
+        __m128 position = _mm_add_ps(c3, _mm_mul_ps(c0, _mm_shuffle_ps(p, p, _MM_SHUFFLE(0, 0, 0, 0))));
+        position = _mm_add_ps(position, _mm_mul_ps(c1, _mm_shuffle_ps(p, p, _MM_SHUFFLE(1, 1, 1, 1))));
+        position = _mm_add_ps(position, _mm_mul_ps(c2, _mm_shuffle_ps(p, p, _MM_SHUFFLE(2, 2, 2, 2))));
+
+        __m128 normal = _mm_setzero_ps();
+        if constexpr (with_normals) {
+            __m128 const n = _mm_loadu_ps(&mesh.normals[vertex].x);
+            normal = _mm_mul_ps(c0, _mm_shuffle_ps(n, n, _MM_SHUFFLE(0, 0, 0, 0)));
+            normal = _mm_add_ps(normal, _mm_mul_ps(c1, _mm_shuffle_ps(n, n, _MM_SHUFFLE(1, 1, 1, 1))));
+            normal = _mm_add_ps(normal, _mm_mul_ps(c2, _mm_shuffle_ps(n, n, _MM_SHUFFLE(2, 2, 2, 2))));
+        }
+        output(vertex, position, normal);
+#else
+        glm::mat4x3 matrix(0.f);
+        for (std::size_t i = 0; i < 4; ++i)
+            matrix += weights[i] * palette[joints[i]];
+        glm::vec3 normal(0.f);
+        if constexpr (with_normals)
+            normal = glm::mat3(matrix) * glm::vec3(mesh.normals[vertex]);
+        output(vertex, matrix * mesh.positions[vertex], normal);
+#endif
+    }
+}
+
+}
+
+void skin_vertices(cpu_skinned_mesh const & mesh, std::span<glm::mat4x3 const> palette, std::span<glm::vec3> positions,
+    std::span<glm::vec3> normals)
+{
+    auto store = [&](std::size_t vertex, auto const & position, auto const & normal)
+    {
+#ifdef CPU_SKINNING_SSE
+        alignas(16) float p[4], n[4];
+        _mm_store_ps(p, position);
+        _mm_store_ps(n, normal);
+        positions[vertex] = glm::vec3(p[0], p[1], p[2]);
+        if (!normals.empty())
+            normals[vertex] = glm::normalize(glm::vec3(n[0], n[1], n[2]));
+#else
+        positions[vertex] = position;
+        if (!normals.empty())
+            normals[vertex] = glm::normalize(normal);
+#endif
+    };
+
+    if (normals.empty())
+        skin<false>(mesh, palette, store);
+    else
+        skin<true>(mesh, palette, store);
+}
+
+bounds posed_bounds(cpu_skinned_mesh const & mesh, std::span<glm::mat4x3 const> palette)
+{
+    float constexpr infinity = std::numeric_limits<float>::infinity();
+#ifdef CPU_SKINNING_SSE
+    __m128 min = _mm_set1_ps(infinity), max = _mm_set1_ps(-infinity);
+    skin<false>(mesh, palette, [&](std::size_t, __m128 position, __m128)
+    {
+        min = _mm_min_ps(min, position);
+        max = _mm_max_ps(max, position);
+    });
+    alignas(16) float lower[4], upper[4];
+    _mm_store_ps(lower, min);
+    _mm_store_ps(upper, max);
+    return {glm::vec3(lower[0], lower[1], lower[2]), glm::vec3(upper[0], upper[1], upper[2])};
+#else
+    bounds result{glm::vec3(infinity), glm::vec3(-infinity)};
+    skin<false>(mesh, palette, [&](std::size_t, glm::vec3 const & position, glm::vec3 const &)
+    {
+        result.min = glm::min(result.min, position);
+        result.max = glm::max(result.max, position);
+    });
+    return result;
+#endif
+}
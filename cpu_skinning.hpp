@@ -0,0 +1,42 @@
+#pragma once
+
+#include "gltf_loader.hpp"
+
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat4x3.hpp>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Vertices of a rigged mesh decoded once for skinning on the CPU, where the shaders' skinned positions are
+// needed: posed bounds for culling, ray picking, simplified shadow casters
+struct cpu_skinned_mesh
+{
+    cpu_skinned_mesh(gltf_model const & model, gltf_model::mesh const & mesh);
+
+    std::size_t vertex_count = 0;
+    // Padded to four components, so that the SSE kernel loads each of them at once
+    std::vector<glm::vec4> positions;
+    std::vector<glm::vec4> normals;
+    std::vector<std::array<std::uint32_t, 4>> joints;
+    // Divided by their sum, as the vertex shader does
+    std::vector<glm::vec4> weights;
+};
+
+struct bounds
+{
+    glm::vec3 min;
+    glm::vec3 max;
+};
+
+// Linear blend skinning of `mesh` with skinning matrices like the ones passed to bone_palette_ring::write.
+// Normals are normalized and skipped when `normals` is empty.
+void skin_vertices(cpu_skinned_mesh const & mesh, std::span<glm::mat4x3 const> palette, std::span<glm::vec3> positions,
+    std::span<glm::vec3> normals = {});
+
+// Bounds of the skinned positions, without storing them
+bounds posed_bounds(cpu_skinned_mesh const & mesh, std::span<glm::mat4x3 const> palette);
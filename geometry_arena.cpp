@@ -0,0 +1,183 @@
+#include "geometry_arena.hpp"
+
+#include <cstring>
+#include <map>
+
+static std::size_t component_size(GLenum type)
+{
+    switch (type) {
+    case GL_BYTE:
+    case GL_UNSIGNED_BYTE:
+        return 1;
+    case GL_SHORT:
+    case GL_UNSIGNED_SHORT:
+        return 2;
+    default:
+        return 4;
+    }
+}
+
+static std::size_t align(std::size_t value, std::size_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+// Reads one byte per page, so a mapped file is paged in by the calling thread
+static void touch_pages(std::span<char const> data)
+{
+    constexpr std::size_t page_size = 4096;
+    volatile char sink = 0;
+    for (std::size_t i = 0; i < data.size(); i += page_size)
+        sink = sink + data[i];
+}
+
+std::array<gltf_model::accessor, geometry_arena::attribute_count> mesh_attributes(gltf_model::mesh const & mesh)
+{
+    std::array<gltf_model::accessor, geometry_arena::attribute_count> result{mesh.position, mesh.normal, mesh.texcoord};
+    if (mesh.is_rigged) {
+        result[3] = mesh.joints;
+        result[4] = mesh.weights;
+    }
+    return result;
+}
+
+geometry_arena::geometry_arena(std::span<gltf_model const> models)
+{
+    auto const format_of = [](gltf_model::mesh const & mesh)
+    {
+        vertex_format result;
+        auto const attributes = mesh_attributes(mesh);
+        for (std::size_t a = 0; a < attribute_count; ++a) {
+            if (attributes[a].type == 0) continue;
+            result[a] = {attributes[a].type, static_cast<GLint>(attributes[a].size), attributes[a].normalized, a == 3};
+        }
+        return result;
+    };
+
+    // Vertex counts per layout, the streams are placed once they are known
+    std::map<vertex_format, std::size_t> layout_of;
+    std::vector<GLsizei> vertex_counts;
+    ranges.resize(models.size());
+    for (std::size_t m = 0; m < models.size(); ++m) {
+        for (auto const & mesh : models[m].meshes) {
+            auto [it, inserted] = layout_of.try_emplace(format_of(mesh), layouts.size());
+            if (inserted) {
+                layouts.push_back({it->first});
+                vertex_counts.push_back(0);
+            }
+            auto const layout = it->second;
+
+            auto const index_size = component_size(mesh.indices.type);
+            index_bytes = align(index_bytes, index_size);
+            ranges[m].push_back({0, mesh.indices.type, static_cast<GLsizei>(mesh.indices.count), index_bytes,
+                                 vertex_counts[layout], static_cast<GLsizei>(mesh.position.count), layout});
+            index_bytes += mesh.indices.count * index_size;
+            vertex_counts[layout] += mesh.position.count;
+        }
+    }
+
+    for (std::size_t l = 0; l < layouts.size(); ++l) {
+        auto & layout = layouts[l];
+        for (std::size_t a = 0; a < attribute_count; ++a) {
+            if (layout.format[a].type == 0) continue;
+            layout.strides[a] = align(component_size(layout.format[a].type) * layout.format[a].size, 4);
+            layout.offsets[a] = vertex_bytes;
+            vertex_bytes += layout.strides[a] * vertex_counts[l];
+        }
+    }
+
+    glGenBuffers(1, &vertex_buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+    glBufferData(GL_ARRAY_BUFFER, vertex_bytes, nullptr, GL_STATIC_DRAW);
+
+    glGenBuffers(1, &index_buffer);
+
+    for (auto & layout : layouts) {
+        glGenVertexArrays(1, &layout.vao);
+        glBindVertexArray(layout.vao);
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer);
+        glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+        for (std::size_t a = 0; a < attribute_count; ++a) {
+            auto const & format = layout.format[a];
+            if (format.type == 0) continue;
+            glEnableVertexAttribArray(a);
+            auto const offset = reinterpret_cast<void *>(layout.offsets[a]);
+            if (format.integer)
+                glVertexAttribIPointer(a, format.size, format.type, layout.strides[a], offset);
+            else
+                glVertexAttribPointer(a, format.size, format.type, format.normalized ? GL_TRUE : GL_FALSE, layout.strides[a], offset);
+        }
+    }
+
+    glBindVertexArray(0);
+    // Allocated with no vertex array bound, so no VAO state changes
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, index_bytes, nullptr, GL_STATIC_DRAW);
+
+    for (auto & model_ranges : ranges)
+        for (auto & range : model_ranges)
+            range.vao = layouts[range.layout].vao;
+}
+
+geometry_arena::~geometry_arena()
+{
+    for (auto const & layout : layouts)
+        glDeleteVertexArrays(1, &layout.vao);
+    glDeleteBuffers(1, &index_buffer);
+    glDeleteBuffers(1, &vertex_buffer);
+}
+
+geometry_arena::staged_mesh geometry_arena::stage(gltf_model const & model, std::size_t model_index, std::size_t mesh_index) const
+{
+    auto const & mesh = model.meshes[mesh_index];
+    auto const & layout = layouts[ranges[model_index][mesh_index].layout];
+
+    staged_mesh result{model_index, mesh_index};
+    result.storage = model.storage;
+
+    auto const attributes = mesh_attributes(mesh);
+    for (std::size_t a = 0; a < attribute_count; ++a) {
+        auto const & accessor = attributes[a];
+        if (accessor.type == 0) continue;
+
+        auto const element_size = component_size(accessor.type) * accessor.size;
+        auto const source_stride = accessor.view.stride ? accessor.view.stride : element_size;
+        auto const source = model.data(accessor);
+        if (source_stride == layout.strides[a]) {
+            // The padding after the last element may lie past the end of the buffer
+            result.streams[a] = {source, accessor.count ? (accessor.count - 1) * source_stride + element_size : 0};
+            touch_pages(result.streams[a]);
+            continue;
+        }
+
+        auto packed = std::make_shared<std::vector<char>>(accessor.count * layout.strides[a]);
+        for (unsigned int v = 0; v < accessor.count; ++v)
+            std::memcpy(packed->data() + v * layout.strides[a], source + v * source_stride, element_size);
+        result.streams[a] = {packed->data(), packed->size()};
+        result.storage.push_back(std::move(packed));
+    }
+
+    result.indices = {model.data(mesh.indices), mesh.indices.count * component_size(mesh.indices.type)};
+    touch_pages(result.indices);
+    return result;
+}
+
+void geometry_arena::upload(staged_mesh const & mesh)
+{
+    auto & range = ranges[mesh.model][mesh.mesh];
+    auto const & layout = layouts[range.layout];
+
+    glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+    for (std::size_t a = 0; a < attribute_count; ++a) {
+        if (layout.format[a].type == 0) continue;
+        glBufferSubData(GL_ARRAY_BUFFER, layout.offsets[a] + range.base_vertex * layout.strides[a],
+                        mesh.streams[a].size(), mesh.streams[a].data());
+    }
+
+    // Through the copy target, so the element buffer binding of whatever VAO is bound stays untouched
+    glBindBuffer(GL_COPY_WRITE_BUFFER, index_buffer);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, range.index_offset, mesh.indices.size(), mesh.indices.data());
+
+    range.resident = true;
+}
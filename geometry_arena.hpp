@@ -0,0 +1,95 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <array>
+#include <compare>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include "gltf_loader.hpp"
+
+// Vertex and index data of all meshes of several models in one vertex buffer and one index buffer.
+// Only the attributes the shaders read and the indices are uploaded. Meshes whose attributes have
+// the same formats share a vertex array object, each attribute being a tightly packed stream, and
+// are told apart by their base vertex and first index.
+struct geometry_arena
+{
+    // Attribute locations of vertex_shader_source, in this order
+    static constexpr std::size_t attribute_count = 5;
+
+    struct attribute_format
+    {
+        GLenum type = 0;
+        GLint size = 0;
+        bool normalized = false;
+        bool integer = false;
+
+        auto operator <=> (attribute_format const &) const = default;
+    };
+
+    using vertex_format = std::array<attribute_format, attribute_count>;
+
+    // Meshes of one vertex format: one stream per attribute, one after another in the vertex buffer
+    struct vertex_layout
+    {
+        vertex_format format;
+        // Offset and padded element size of each attribute stream
+        std::array<std::size_t, attribute_count> offsets{};
+        std::array<std::size_t, attribute_count> strides{};
+        GLuint vao = 0;
+    };
+
+    struct draw_range
+    {
+        GLuint vao;
+        GLenum index_type;
+        GLsizei index_count;
+        // Byte offset into the index buffer
+        std::uintptr_t index_offset;
+        GLint base_vertex;
+        GLsizei vertex_count;
+        std::size_t layout;
+        // Set once the data of the mesh has been uploaded, see upload
+        bool resident = false;
+    };
+
+    // Data of one mesh in the arena layout, ready to be copied into the buffers
+    struct staged_mesh
+    {
+        std::size_t model;
+        std::size_t mesh;
+        std::array<std::span<char const>, attribute_count> streams;
+        std::span<char const> indices;
+        // Keeps the model buffers alive, and owns the streams that had to be repacked
+        std::vector<std::shared_ptr<void const>> storage;
+    };
+
+    // Lays out the meshes and allocates the buffers, no mesh is resident yet
+    explicit geometry_arena(std::span<gltf_model const> models);
+    ~geometry_arena();
+
+    geometry_arena(geometry_arena const &) = delete;
+    geometry_arena & operator = (geometry_arena const &) = delete;
+
+    // Repacks the mesh where its layout differs from the arena's and faults its pages in; does not touch GL,
+    // so it can run on any thread
+    staged_mesh stage(gltf_model const & model, std::size_t model_index, std::size_t mesh_index) const;
+
+    // Copies a staged mesh into the buffers and makes it resident; GL thread only
+    void upload(staged_mesh const & mesh);
+
+    // Ranges of the meshes of the model passed at the same position to the constructor
+    std::vector<std::vector<draw_range>> ranges;
+    std::vector<vertex_layout> layouts;
+
+    GLuint vertex_buffer = 0;
+    GLuint index_buffer = 0;
+    std::size_t vertex_bytes = 0;
+    std::size_t index_bytes = 0;
+};
+
+// Accessors of a mesh at the attribute locations of the arena, absent attributes have no type
+std::array<gltf_model::accessor, geometry_arena::attribute_count> mesh_attributes(gltf_model::mesh const & mesh);
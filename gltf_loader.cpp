@@ -1,243 +1,1080 @@
 #include "gltf_loader.hpp"
+#include "mapped_file.hpp"
+#include "meshopt_decoder.hpp"
 
-#include <rapidjson/document.h>
-#include <rapidjson/istreamwrapper.h>
+#include <rapidjson/reader.h>
+#include <rapidjson/memorystream.h>
 
 #include <fstream>
 #include <stdexcept>
-#include <GL/glew.h>
+#include <cstring>
+#include <string_view>
+#include <array>
+#include <limits>
+#include <utility>
 
+static constexpr std::uint32_t glb_magic = 0x46546C67; // "glTF"
+static constexpr std::uint32_t glb_chunk_json = 0x4E4F534A; // "JSON"
+static constexpr std::uint32_t glb_chunk_bin = 0x004E4942; // "BIN\0"
 
-static unsigned int attribute_type_to_size(std::string const & type)
+static unsigned int component_size(unsigned int component_type)
+{
+    switch (component_type) {
+    case 0x1400: // GL_BYTE
+    case 0x1401: // GL_UNSIGNED_BYTE
+        return 1;
+    case 0x1402: // GL_SHORT
+    case 0x1403: // GL_UNSIGNED_SHORT
+        return 2;
+    default:
+        return 4;
+    }
+}
+
+// Converts one component to float, dequantizing normalized integers as the glTF spec prescribes
+static float read_component(char const * source, unsigned int component_type, bool normalized)
+{
+    auto load = [source]<typename T>(T){ T value; std::memcpy(&value, source, sizeof(value)); return value; };
+    switch (component_type) {
+    case 0x1400: // GL_BYTE
+        return normalized ? std::max(load(std::int8_t{}) / 127.f, -1.f) : load(std::int8_t{});
+    case 0x1401: // GL_UNSIGNED_BYTE
+        return normalized ? load(std::uint8_t{}) / 255.f : load(std::uint8_t{});
+    case 0x1402: // GL_SHORT
+        return normalized ? std::max(load(std::int16_t{}) / 32767.f, -1.f) : load(std::int16_t{});
+    case 0x1403: // GL_UNSIGNED_SHORT
+        return normalized ? load(std::uint16_t{}) / 65535.f : load(std::uint16_t{});
+    case 0x1405: // GL_UNSIGNED_INT
+        return load(std::uint32_t{});
+    default:
+        return load(float{});
+    }
+}
+
+static unsigned int attribute_type_to_size(std::string_view type)
 {
     if (type == "SCALAR") return 1;
     if (type == "VEC2") return 2;
     if (type == "VEC3") return 3;
     if (type == "VEC4") return 4;
+    if (type == "MAT4") return 16;
     return 0;
 }
 
-gltf_model load_gltf(std::filesystem::path const & path)
+// Returns the owner of the file contents together with a view of them
+static std::pair<std::shared_ptr<void const>, std::span<char const>> load_file(std::filesystem::path const & path, gltf_buffer_mode mode)
 {
-    rapidjson::Document document;
+    if (mode == gltf_buffer_mode::map) {
+        auto file = std::make_shared<mapped_file>(path);
+        auto data = file->data();
+        return {std::move(file), data};
+    }
+
+    auto file = std::make_shared<std::vector<char>>(std::filesystem::file_size(path));
+    std::ifstream input(path, std::ios::binary);
+    if (!input.read(file->data(), file->size()))
+        throw std::runtime_error("Failed to read " + path.string());
+    std::span<char const> data(file->data(), file->size());
+    return {std::move(file), data};
+}
+
+static std::uint32_t read_u32(std::span<char const> data, std::size_t offset)
+{
+    std::uint32_t result;
+    std::memcpy(&result, data.data() + offset, sizeof(result));
+    return result;
+}
+
+// Splits a .glb container into its JSON and (optional) BIN chunks without copying them
+static std::pair<std::span<char const>, std::span<char const>> split_glb(std::span<char const> file, std::string const & name)
+{
+    if (file.size() < 20 || read_u32(file, 0) != glb_magic)
+        throw std::runtime_error("Not a binary glTF file: " + name);
+    if (read_u32(file, 4) != 2)
+        throw std::runtime_error("Unsupported binary glTF version: " + name);
+
+    std::size_t const length = std::min<std::size_t>(read_u32(file, 8), file.size());
+
+    std::span<char const> json, bin;
+    for (std::size_t offset = 12; offset + 8 <= length;) {
+        std::size_t const chunk_length = read_u32(file, offset);
+        std::uint32_t const chunk_type = read_u32(file, offset + 4);
+        offset += 8;
+        if (offset + chunk_length > length)
+            throw std::runtime_error("Truncated binary glTF chunk: " + name);
+
+        if (chunk_type == glb_chunk_json && json.empty())
+            json = file.subspan(offset, chunk_length);
+        else if (chunk_type == glb_chunk_bin && bin.empty())
+            bin = file.subspan(offset, chunk_length);
+
+        offset += chunk_length;
+    }
+
+    if (json.empty())
+        throw std::runtime_error("Binary glTF without JSON chunk: " + name);
+    return {json, bin};
+}
+
+// Compact tables of the parts of a glTF document the loader uses, filled in one streaming pass.
+// Indices into other tables are -1 when absent.
+struct gltf_document
+{
+    struct buffer
+    {
+        std::optional<std::string> uri;
+        unsigned int byte_length = 0;
+        // Uncompressed copy of EXT_meshopt_compression data, never needed since we decode
+        bool fallback = false;
+    };
+
+    enum class meshopt_mode
+    {
+        none,
+        attributes,
+        triangles,
+        indices,
+    };
+
+    struct buffer_view
+    {
+        unsigned int buffer = 0;
+        unsigned int byte_offset = 0;
+        unsigned int byte_length = 0;
+        unsigned int byte_stride = 0;
+
+        // EXT_meshopt_compression source of the view, mode == none for plain views
+        struct
+        {
+            unsigned int buffer = 0;
+            unsigned int byte_offset = 0;
+            unsigned int byte_length = 0;
+            unsigned int byte_stride = 0;
+            unsigned int count = 0;
+            meshopt_mode mode = meshopt_mode::none;
+            // Empty for filters we do not know
+            std::optional<meshopt_filter> filter = meshopt_filter::none;
+        } compression;
+    };
+
+    struct accessor
+    {
+        int buffer_view = -1;
+        unsigned int byte_offset = 0;
+        unsigned int component_type = 0;
+        unsigned int count = 0;
+        unsigned int size = 0;
+        bool normalized = false;
+        glm::vec3 min{0.f};
+        glm::vec3 max{0.f};
+
+        // Elements replaced on top of the bufferView (or on top of zeros without one), count == 0 if not sparse
+        struct
+        {
+            unsigned int count = 0;
+            int indices_view = -1;
+            unsigned int indices_offset = 0;
+            unsigned int indices_type = 0;
+            int values_view = -1;
+            unsigned int values_offset = 0;
+        } sparse;
+    };
+
+    struct primitive
+    {
+        int indices = -1;
+        int material = -1;
+        int position = -1;
+        int normal = -1;
+        int texcoord = -1;
+        int joints = -1;
+        int weights = -1;
+    };
 
+    struct mesh
     {
-        std::ifstream input(path, std::ios::binary);
-        rapidjson::IStreamWrapper stream(input);
-        document.ParseStream(stream);
+        std::string name;
+        std::vector<primitive> primitives;
+    };
+
+    struct material
+    {
+        bool double_sided = false;
+        bool blend = false;
+        int base_color_texture = -1;
+        std::optional<glm::vec4> base_color_factor;
+        float metallic_factor = 1.f;
+        float roughness_factor = 1.f;
+    };
+
+    struct texture
+    {
+        int source = -1;
+    };
+
+    struct image
+    {
+        std::optional<std::string> uri;
+        int buffer_view = -1;
+    };
+
+    struct node
+    {
+        std::string name;
+        std::vector<int> children;
+    };
+
+    struct skin
+    {
+        int inverse_bind_matrices = -1;
+        std::vector<int> joints;
+    };
+
+    struct animation_sampler
+    {
+        int input = -1;
+        int output = -1;
+    };
+
+    enum class channel_path
+    {
+        other,
+        translation,
+        rotation,
+        scale,
+    };
+
+    struct animation_channel
+    {
+        int sampler = -1;
+        int node = -1;
+        channel_path path = channel_path::other;
+    };
+
+    struct animation
+    {
+        std::string name;
+        std::vector<animation_sampler> samplers;
+        std::vector<animation_channel> channels;
+    };
+
+    std::vector<buffer> buffers;
+    std::vector<buffer_view> buffer_views;
+    std::vector<accessor> accessors;
+    std::vector<mesh> meshes;
+    std::vector<material> materials;
+    std::vector<texture> textures;
+    std::vector<image> images;
+    std::vector<node> nodes;
+    std::vector<skin> skins;
+    std::vector<animation> animations;
+};
+
+// Object keys the parser cares about, everything else is `other` and never matches a path
+enum class json_key : unsigned char
+{
+    other,
+    accessors, alpha_mode, animations, attributes, base_color_factor, base_color_texture, buffer, buffer_view,
+    buffer_views, buffers, byte_length, byte_offset, byte_stride, channels, children, component_type, count,
+    double_sided, ext_meshopt_compression, extensions, fallback, filter, images, index, indices, input,
+    inverse_bind_matrices, joints, joints_0, material, materials, max, meshes, metallic_factor, min, mode, name, node,
+    nodes, normal, normalized, output, path, pbr_metallic_roughness, position, primitives, roughness_factor, sampler,
+    samplers, skins, source, sparse, target, texcoord_0, textures, type, uri, values, weights_0,
+};
+
+static json_key to_json_key(std::string_view name)
+{
+    static std::unordered_map<std::string_view, json_key> const keys{
+            {"accessors", json_key::accessors},
+            {"alphaMode", json_key::alpha_mode},
+            {"animations", json_key::animations},
+            {"attributes", json_key::attributes},
+            {"baseColorFactor", json_key::base_color_factor},
+            {"baseColorTexture", json_key::base_color_texture},
+            {"buffer", json_key::buffer},
+            {"bufferView", json_key::buffer_view},
+            {"bufferViews", json_key::buffer_views},
+            {"buffers", json_key::buffers},
+            {"byteLength", json_key::byte_length},
+            {"byteOffset", json_key::byte_offset},
+            {"byteStride", json_key::byte_stride},
+            {"channels", json_key::channels},
+            {"children", json_key::children},
+            {"componentType", json_key::component_type},
+            {"count", json_key::count},
+            {"doubleSided", json_key::double_sided},
+            {"EXT_meshopt_compression", json_key::ext_meshopt_compression},
+            {"extensions", json_key::extensions},
+            {"fallback", json_key::fallback},
+            {"filter", json_key::filter},
+            {"images", json_key::images},
+            {"index", json_key::index},
+            {"indices", json_key::indices},
+            {"input", json_key::input},
+            {"inverseBindMatrices", json_key::inverse_bind_matrices},
+            {"joints", json_key::joints},
+            {"JOINTS_0", json_key::joints_0},
+            {"material", json_key::material},
+            {"materials", json_key::materials},
+            {"max", json_key::max},
+            {"meshes", json_key::meshes},
+            {"metallicFactor", json_key::metallic_factor},
+            {"min", json_key::min},
+            {"mode", json_key::mode},
+            {"name", json_key::name},
+            {"node", json_key::node},
+            {"nodes", json_key::nodes},
+            {"NORMAL", json_key::normal},
+            {"normalized", json_key::normalized},
+            {"output", json_key::output},
+            {"path", json_key::path},
+            {"pbrMetallicRoughness", json_key::pbr_metallic_roughness},
+            {"POSITION", json_key::position},
+            {"primitives", json_key::primitives},
+            {"roughnessFactor", json_key::roughness_factor},
+            {"sampler", json_key::sampler},
+            {"samplers", json_key::samplers},
+            {"skins", json_key::skins},
+            {"source", json_key::source},
+            {"sparse", json_key::sparse},
+            {"target", json_key::target},
+            {"TEXCOORD_0", json_key::texcoord_0},
+            {"textures", json_key::textures},
+            {"type", json_key::type},
+            {"uri", json_key::uri},
+            {"values", json_key::values},
+            {"WEIGHTS_0", json_key::weights_0},
+    };
+
+    auto it = keys.find(name);
+    return it == keys.end() ? json_key::other : it->second;
+}
+
+// rapidjson SAX handler filling gltf_document. It tracks the current path as the keys of the enclosing
+// objects plus the indices of the enclosing arrays and stores each scalar according to that path.
+struct gltf_document_handler
+{
+    gltf_document & document;
+
+    std::vector<json_key> keys;
+    std::vector<int> indices;
+    // true for arrays, false for objects
+    std::vector<bool> frames;
+
+    template <typename ... Keys>
+    bool at(Keys ... path) const
+    {
+        json_key const expected[] = {path...};
+        return keys.size() == sizeof...(Keys) && std::equal(keys.begin(), keys.end(), expected);
+    }
+
+    template <typename T>
+    static T & element(std::vector<T> & vector, int index)
+    {
+        if (index >= static_cast<int>(vector.size()))
+            vector.resize(index + 1);
+        return vector[index];
+    }
+
+    // Called before every value; advances the index of an enclosing array
+    void begin_value()
+    {
+        if (!frames.empty() && frames.back())
+            ++indices.back();
+    }
+
+    void number(double value)
+    {
+        using k = json_key;
+        auto const u = static_cast<unsigned int>(value);
+        auto const i = static_cast<int>(value);
+        auto const f = static_cast<float>(value);
+        auto const index = [this](std::size_t n){ return indices[n]; };
+        if (indices.empty())
+            return;
+
+        switch (keys.empty() ? k::other : keys[0]) {
+        case k::buffers:
+            if (at(k::buffers, k::byte_length)) element(document.buffers, index(0)).byte_length = u;
+            break;
+        case k::buffer_views: {
+            auto & view = element(document.buffer_views, index(0));
+            if (keys.size() == 4 && keys[1] == k::extensions && keys[2] == k::ext_meshopt_compression) {
+                switch (keys[3]) {
+                case k::buffer: view.compression.buffer = u; break;
+                case k::byte_offset: view.compression.byte_offset = u; break;
+                case k::byte_length: view.compression.byte_length = u; break;
+                case k::byte_stride: view.compression.byte_stride = u; break;
+                case k::count: view.compression.count = u; break;
+                default: break;
+                }
+            }
+            if (keys.size() != 2) break;
+            switch (keys[1]) {
+            case k::buffer: view.buffer = u; break;
+            case k::byte_offset: view.byte_offset = u; break;
+            case k::byte_length: view.byte_length = u; break;
+            case k::byte_stride: view.byte_stride = u; break;
+            default: break;
+            }
+            break;
+        }
+        case k::accessors: {
+            auto & accessor = element(document.accessors, index(0));
+            if (at(k::accessors, k::sparse, k::count)) accessor.sparse.count = u;
+            else if (at(k::accessors, k::sparse, k::indices, k::buffer_view)) accessor.sparse.indices_view = i;
+            else if (at(k::accessors, k::sparse, k::indices, k::byte_offset)) accessor.sparse.indices_offset = u;
+            else if (at(k::accessors, k::sparse, k::indices, k::component_type)) accessor.sparse.indices_type = u;
+            else if (at(k::accessors, k::sparse, k::values, k::buffer_view)) accessor.sparse.values_view = i;
+            else if (at(k::accessors, k::sparse, k::values, k::byte_offset)) accessor.sparse.values_offset = u;
+            if (keys.size() != 2) break;
+            switch (keys[1]) {
+            case k::buffer_view: accessor.buffer_view = i; break;
+            case k::byte_offset: accessor.byte_offset = u; break;
+            case k::component_type: accessor.component_type = u; break;
+            case k::count: accessor.count = u; break;
+            case k::min: if (index(1) < 3) accessor.min[index(1)] = f; break;
+            case k::max: if (index(1) < 3) accessor.max[index(1)] = f; break;
+            default: break;
+            }
+            break;
+        }
+        case k::meshes: {
+            if (keys.size() < 2 || keys[1] != k::primitives) break;
+            auto & primitive = element(element(document.meshes, index(0)).primitives, index(1));
+            if (at(k::meshes, k::primitives, k::indices)) primitive.indices = i;
+            else if (at(k::meshes, k::primitives, k::material)) primitive.material = i;
+            else if (keys.size() == 4 && keys[2] == k::attributes) {
+                switch (keys[3]) {
+                case k::position: primitive.position = i; break;
+                case k::normal: primitive.normal = i; break;
+                case k::texcoord_0: primitive.texcoord = i; break;
+                case k::joints_0: primitive.joints = i; break;
+                case k::weights_0: primitive.weights = i; break;
+                default: break;
+                }
+            }
+            break;
+        }
+        case k::materials: {
+            auto & material = element(document.materials, index(0));
+            if (at(k::materials, k::pbr_metallic_roughness, k::base_color_texture, k::index))
+                material.base_color_texture = i;
+            else if (at(k::materials, k::pbr_metallic_roughness, k::base_color_factor) && index(1) < 4) {
+                if (!material.base_color_factor) material.base_color_factor = glm::vec4(1.f);
+                (*material.base_color_factor)[index(1)] = f;
+            }
+            else if (at(k::materials, k::pbr_metallic_roughness, k::metallic_factor)) material.metallic_factor = f;
+            else if (at(k::materials, k::pbr_metallic_roughness, k::roughness_factor)) material.roughness_factor = f;
+            break;
+        }
+        case k::textures:
+            if (at(k::textures, k::source)) element(document.textures, index(0)).source = i;
+            break;
+        case k::images:
+            if (at(k::images, k::buffer_view)) element(document.images, index(0)).buffer_view = i;
+            break;
+        case k::nodes:
+            if (at(k::nodes, k::children)) element(document.nodes, index(0)).children.push_back(i);
+            break;
+        case k::skins:
+            if (at(k::skins, k::inverse_bind_matrices)) element(document.skins, index(0)).inverse_bind_matrices = i;
+            else if (at(k::skins, k::joints)) element(document.skins, index(0)).joints.push_back(i);
+            break;
+        case k::animations: {
+            if (keys.size() < 2) break;
+            auto & animation = element(document.animations, index(0));
+            if (at(k::animations, k::samplers, k::input)) element(animation.samplers, index(1)).input = i;
+            else if (at(k::animations, k::samplers, k::output)) element(animation.samplers, index(1)).output = i;
+            else if (at(k::animations, k::channels, k::sampler)) element(animation.channels, index(1)).sampler = i;
+            else if (at(k::animations, k::channels, k::target, k::node)) element(animation.channels, index(1)).node = i;
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    void string(std::string_view value)
+    {
+        using k = json_key;
+        if (keys.empty() || indices.empty())
+            return;
+        int const index = indices[0];
+
+        if (at(k::buffers, k::uri)) element(document.buffers, index).uri = std::string(value);
+        else if (at(k::images, k::uri)) element(document.images, index).uri = std::string(value);
+        else if (at(k::accessors, k::type)) element(document.accessors, index).size = attribute_type_to_size(value);
+        else if (at(k::buffer_views, k::extensions, k::ext_meshopt_compression, k::mode)) {
+            using mode = gltf_document::meshopt_mode;
+            auto & compression = element(document.buffer_views, index).compression;
+            if (value == "ATTRIBUTES") compression.mode = mode::attributes;
+            else if (value == "TRIANGLES") compression.mode = mode::triangles;
+            else if (value == "INDICES") compression.mode = mode::indices;
+        }
+        else if (at(k::buffer_views, k::extensions, k::ext_meshopt_compression, k::filter)) {
+            auto & compression = element(document.buffer_views, index).compression;
+            if (value == "NONE") compression.filter = meshopt_filter::none;
+            else if (value == "OCTAHEDRAL") compression.filter = meshopt_filter::octahedral;
+            else if (value == "QUATERNION") compression.filter = meshopt_filter::quaternion;
+            else if (value == "EXPONENTIAL") compression.filter = meshopt_filter::exponential;
+            else compression.filter.reset();
+        }
+        else if (at(k::meshes, k::name)) element(document.meshes, index).name = value;
+        else if (at(k::nodes, k::name)) element(document.nodes, index).name = value;
+        else if (at(k::animations, k::name)) element(document.animations, index).name = value;
+        else if (at(k::materials, k::alpha_mode)) element(document.materials, index).blend = (value == "BLEND");
+        else if (at(k::animations, k::channels, k::target, k::path)) {
+            auto & channel = element(element(document.animations, index).channels, indices[1]);
+            if (value == "translation") channel.path = gltf_document::channel_path::translation;
+            else if (value == "rotation") channel.path = gltf_document::channel_path::rotation;
+            else if (value == "scale") channel.path = gltf_document::channel_path::scale;
+        }
     }
 
+    bool Null() { begin_value(); return true; }
+    bool Bool(bool value)
+    {
+        begin_value();
+        if (at(json_key::materials, json_key::double_sided))
+            element(document.materials, indices[0]).double_sided = value;
+        else if (at(json_key::accessors, json_key::normalized))
+            element(document.accessors, indices[0]).normalized = value;
+        else if (at(json_key::buffers, json_key::extensions, json_key::ext_meshopt_compression, json_key::fallback))
+            element(document.buffers, indices[0]).fallback = value;
+        return true;
+    }
+    bool Int(int value) { begin_value(); number(value); return true; }
+    bool Uint(unsigned value) { begin_value(); number(value); return true; }
+    bool Int64(std::int64_t value) { begin_value(); number(static_cast<double>(value)); return true; }
+    bool Uint64(std::uint64_t value) { begin_value(); number(static_cast<double>(value)); return true; }
+    bool Double(double value) { begin_value(); number(value); return true; }
+    bool RawNumber(char const *, rapidjson::SizeType, bool) { return true; }
+    bool String(char const * value, rapidjson::SizeType length, bool)
+    {
+        begin_value();
+        string({value, length});
+        return true;
+    }
+
+    bool StartObject()
+    {
+        begin_value();
+        frames.push_back(false);
+        keys.push_back(json_key::other);
+        return true;
+    }
+
+    bool Key(char const * name, rapidjson::SizeType length, bool)
+    {
+        keys.back() = to_json_key({name, length});
+        return true;
+    }
+
+    bool EndObject(rapidjson::SizeType)
+    {
+        frames.pop_back();
+        keys.pop_back();
+        return true;
+    }
+
+    bool StartArray()
+    {
+        begin_value();
+        frames.push_back(true);
+        indices.push_back(-1);
+        return true;
+    }
+
+    bool EndArray(rapidjson::SizeType)
+    {
+        frames.pop_back();
+        indices.pop_back();
+        return true;
+    }
+};
+
+gltf_model load_gltf(std::filesystem::path const & path, gltf_buffer_mode mode)
+{
     gltf_model result;
 
+    // BIN chunk of a .glb, used by the buffer that has no uri
+    std::span<char const> glb_bin;
+
+    gltf_document document;
     {
-        auto buffers = document["buffers"].GetArray();
-        assert(buffers.Size() == 1);
+        auto [file, data] = load_file(path, mode);
+        std::span<char const> json = data;
+        if (path.extension() == ".glb") {
+            std::tie(json, glb_bin) = split_glb(data, path.string());
+            // The container stays alive as the storage of the BIN chunk buffer, so it is read only once
+            result.storage.push_back(std::move(file));
+        }
 
-        auto const buffer_uri = buffers[0]["uri"].GetString();
+        gltf_document_handler handler{document};
+        rapidjson::MemoryStream stream(json.data(), json.size());
+        rapidjson::Reader reader;
+        if (!reader.Parse(stream, handler))
+            throw std::runtime_error("Failed to parse " + path.string());
+    }
 
-        auto const buffer_path = path.parent_path() / buffer_uri;
+    for (auto const & buffer : document.buffers) {
+        if (buffer.fallback) {
+            result.buffers.emplace_back();
+            continue;
+        }
+        if (!buffer.uri) {
+            if (glb_bin.size() < buffer.byte_length)
+                throw std::runtime_error("Missing binary chunk for buffer in " + path.string());
+            result.buffers.push_back(glb_bin.first(buffer.byte_length));
+            continue;
+        }
 
-        result.buffer.resize(std::filesystem::file_size(buffer_path));
-        std::ifstream buffer(buffer_path, std::ios::binary);
-        buffer.read(result.buffer.data(), result.buffer.size());
+        auto [file, data] = load_file(path.parent_path() / *buffer.uri, mode);
+        if (data.size() < buffer.byte_length)
+            throw std::runtime_error("Buffer file is shorter than its byteLength in " + path.string());
+        result.buffers.push_back(data.first(buffer.byte_length));
+        result.storage.push_back(std::move(file));
     }
 
-    auto parse_buffer_view = [&](int index) -> gltf_model::buffer_view
+    // EXT_meshopt_compression views are decoded once into a buffer of their own and read like plain views afterwards
     {
-        auto view = document["bufferViews"].GetArray()[index].GetObject();
-        unsigned int offset = 0, stride = 0;
-        if (view.HasMember("byteOffset")) {
-            offset = view["byteOffset"].GetUint();
+        using mode = gltf_document::meshopt_mode;
+        auto decoded = std::make_shared<std::vector<char>>();
+        unsigned int const decoded_buffer = result.buffers.size();
+        std::vector<std::size_t> decoded_offsets(document.buffer_views.size());
+        for (std::size_t v = 0; v < document.buffer_views.size(); ++v) {
+            auto const & compression = document.buffer_views[v].compression;
+            if (compression.mode == mode::none) continue;
+            decoded->resize((decoded->size() + 3) / 4 * 4);
+            decoded_offsets[v] = decoded->size();
+            decoded->resize(decoded->size() + std::size_t(compression.count) * compression.byte_stride);
         }
-        if (view.HasMember("byteStride")) {
-            stride = view["byteStride"].GetUint();
+
+        for (std::size_t v = 0; v < document.buffer_views.size(); ++v) {
+            auto & view = document.buffer_views[v];
+            auto const & compression = view.compression;
+            if (compression.mode == mode::none) continue;
+
+            if (!compression.filter)
+                throw std::runtime_error("Unsupported EXT_meshopt_compression filter in " + path.string());
+            auto const & source_buffer = result.buffers.at(compression.buffer);
+            if (std::size_t(compression.byte_offset) + compression.byte_length > source_buffer.size())
+                throw std::runtime_error("EXT_meshopt_compression data out of its buffer in " + path.string());
+
+            auto const source = source_buffer.subspan(compression.byte_offset, compression.byte_length);
+            std::span<char> destination(decoded->data() + decoded_offsets[v], std::size_t(compression.count) * compression.byte_stride);
+            switch (compression.mode) {
+            case mode::attributes:
+                decode_meshopt_vertices(destination, compression.count, compression.byte_stride, source);
+                apply_meshopt_filter(*compression.filter, destination, compression.count, compression.byte_stride);
+                break;
+            case mode::triangles:
+                decode_meshopt_triangles(destination, compression.count, compression.byte_stride, source);
+                break;
+            case mode::indices:
+                decode_meshopt_indices(destination, compression.count, compression.byte_stride, source);
+                break;
+            default:
+                break;
+            }
+
+            view.buffer = decoded_buffer;
+            view.byte_offset = decoded_offsets[v];
+            view.byte_length = destination.size();
         }
-        return {offset, view["byteLength"].GetUint(), stride};
+
+        if (!decoded->empty()) {
+            result.buffers.emplace_back(decoded->data(), decoded->size());
+            result.storage.push_back(std::move(decoded));
+        }
+    }
+
+    auto parse_buffer_view = [&](int index) -> gltf_model::buffer_view
+    {
+        auto const & view = document.buffer_views.at(index);
+        return {view.buffer, view.byte_offset, view.byte_length, view.byte_stride};
     };
 
-    auto parse_accessor = [&](int index) -> gltf_model::accessor
+    // Copies the elements of an accessor tightly packed
+    auto copy_elements = [&](gltf_model::accessor const & accessor, char * destination)
+    {
+        auto const element_size = component_size(accessor.type) * accessor.size;
+        auto const stride = accessor.view.stride ? accessor.view.stride : element_size;
+        auto const source = result.data(accessor);
+        for (unsigned int i = 0; i < accessor.count; ++i)
+            std::memcpy(destination + i * element_size, source + i * stride, element_size);
+    };
+
+    auto read_index = [&](gltf_model::accessor const & accessor, unsigned int i) -> std::uint32_t
+    {
+        auto const source = result.data(accessor) + i * component_size(accessor.type);
+        switch (accessor.type) {
+        case 0x1401: return *reinterpret_cast<std::uint8_t const *>(source); // GL_UNSIGNED_BYTE
+        case 0x1403: return *reinterpret_cast<std::uint16_t const *>(source); // GL_UNSIGNED_SHORT
+        default: return *reinterpret_cast<std::uint32_t const *>(source); // GL_UNSIGNED_INT
+        }
+    };
+
+    // Sparse accessors and accessors without a bufferView are expanded into a buffer of their own
+    // before anything reads them, so the rest of the loader and the renderer only see plain arrays
+    std::vector<std::optional<gltf_model::buffer_view>> expanded_views(document.accessors.size());
     {
-        unsigned int offset = 0;
-        auto accessor = document["accessors"].GetArray()[index].GetObject();
-        if (accessor.HasMember("byteOffset")) {
-            offset = accessor["byteOffset"].GetUint();
+        auto expanded = std::make_shared<std::vector<char>>();
+        unsigned int const expanded_buffer = result.buffers.size();
+        for (std::size_t a = 0; a < document.accessors.size(); ++a) {
+            auto const & accessor = document.accessors[a];
+            if (accessor.buffer_view != -1 && accessor.sparse.count == 0) continue;
+            auto const size = accessor.count * component_size(accessor.component_type) * accessor.size;
+            expanded->resize((expanded->size() + 3) / 4 * 4);
+            expanded_views[a] = gltf_model::buffer_view{expanded_buffer, static_cast<unsigned int>(expanded->size()), size, 0};
+            expanded->resize(expanded->size() + size);
+        }
+
+        for (std::size_t a = 0; a < document.accessors.size(); ++a) {
+            if (!expanded_views[a]) continue;
+            auto const & accessor = document.accessors[a];
+            auto const element_size = component_size(accessor.component_type) * accessor.size;
+            auto const destination = expanded->data() + expanded_views[a]->offset;
+
+            if (accessor.buffer_view != -1)
+                copy_elements({parse_buffer_view(accessor.buffer_view), accessor.component_type, accessor.size, accessor.count, accessor.byte_offset}, destination);
+
+            auto const & sparse = accessor.sparse;
+            if (sparse.count == 0) continue;
+            gltf_model::accessor const indices{parse_buffer_view(sparse.indices_view), sparse.indices_type, 1, sparse.count, sparse.indices_offset};
+            gltf_model::accessor const values{parse_buffer_view(sparse.values_view), accessor.component_type, accessor.size, sparse.count, sparse.values_offset};
+            for (unsigned int i = 0; i < sparse.count; ++i) {
+                auto const target = read_index(indices, i);
+                if (target >= accessor.count)
+                    throw std::runtime_error("Sparse accessor index out of range in " + path.string());
+                std::memcpy(destination + target * element_size, result.data(values) + i * element_size, element_size);
+            }
+        }
+
+        if (!expanded->empty()) {
+            result.buffers.emplace_back(expanded->data(), expanded->size());
+            result.storage.push_back(std::move(expanded));
         }
+    }
+
+    auto parse_accessor = [&](int index) -> gltf_model::accessor
+    {
+        auto const & accessor = document.accessors.at(index);
+        if (expanded_views[index])
+            return {*expanded_views[index], accessor.component_type, accessor.size, accessor.count, 0, accessor.normalized};
         return {
-                parse_buffer_view(accessor["bufferView"].GetInt()),
-                accessor["componentType"].GetUint(),
-                attribute_type_to_size(accessor["type"].GetString()),
-                accessor["count"].GetUint(),
-                offset,
+                parse_buffer_view(accessor.buffer_view),
+                accessor.component_type,
+                accessor.size,
+                accessor.count,
+                accessor.byte_offset,
+                accessor.normalized,
         };
     };
 
-    auto parse_texture = [&](int index) -> std::string
+    auto parse_texture = [&](int index, gltf_model::material & material)
     {
-        auto const source_index = document["textures"].GetArray()[index]["source"].GetInt();
-        return document["images"].GetArray()[source_index]["uri"].GetString();
+        auto const source_index = document.textures.at(index).source;
+        auto const & image = document.images.at(source_index);
+        if (image.uri) {
+            material.texture_path = *image.uri;
+        } else {
+            // Embedded image, the path only serves as a key for texture caching
+            material.texture_path = "#image" + std::to_string(source_index);
+            material.texture_view = parse_buffer_view(image.buffer_view);
+        }
     };
 
-    auto parse_color = [&](auto const & array)
+    // Data created by the loader (merged vertices and indices) goes into an extra buffer appended at the end
+    auto generated = std::make_shared<std::vector<char>>();
+    unsigned int const generated_buffer = result.buffers.size();
+
+    auto generate = [&](std::size_t size) -> gltf_model::buffer_view
     {
-        return glm::vec4{
-                array[0].GetFloat(),
-                array[1].GetFloat(),
-                array[2].GetFloat(),
-                array[3].GetFloat(),
-        };
+        generated->resize((generated->size() + 3) / 4 * 4);
+        gltf_model::buffer_view view{generated_buffer, static_cast<unsigned int>(generated->size()), static_cast<unsigned int>(size), 0};
+        generated->resize(generated->size() + size);
+        return view;
     };
 
-    auto parse_vector = [&](auto const & array)
+    auto generated_data = [&](gltf_model::buffer_view const & view)
     {
-        return glm::vec3{
-                array[0].GetFloat(),
-                array[1].GetFloat(),
-                array[2].GetFloat(),
-        };
+        return generated->data() + view.offset;
     };
 
-    auto parse_bounds = [&](int index)
+    auto vertex_attributes = [](gltf_document::primitive const & primitive)
     {
-        auto accessor = document["accessors"].GetArray()[index].GetObject();
-        return std::make_pair(
-                parse_vector(accessor["min"]),
-                parse_vector(accessor["max"])
-        );
+        return std::array{primitive.position, primitive.normal, primitive.texcoord, primitive.joints, primitive.weights};
     };
 
-    for (auto const & mesh : document["meshes"].GetArray()) {
-        auto &result_mesh = result.meshes.emplace_back();
-        result_mesh.name = mesh["name"].GetString();
+    // Primitives can only share an index range if their attributes have the same formats
+    auto vertex_layout = [&](gltf_document::primitive const & primitive)
+    {
+        std::array<unsigned int, 15> result{};
+        auto const attributes = vertex_attributes(primitive);
+        for (std::size_t i = 0; i < attributes.size(); ++i) {
+            if (attributes[i] == -1) continue;
+            result[3 * i] = document.accessors.at(attributes[i]).component_type;
+            result[3 * i + 1] = document.accessors.at(attributes[i]).size;
+            result[3 * i + 2] = document.accessors.at(attributes[i]).normalized;
+        }
+        return result;
+    };
 
-        auto primitives = mesh["primitives"].GetArray();
-        assert(primitives.Size() == 1);
+    // Builds the vertex and index accessors of one draw out of primitives with the same material and layout
+    auto merge_primitives = [&](std::vector<gltf_document::primitive const *> const & primitives, gltf_model::mesh & result_mesh)
+    {
+        // Distinct vertex arrays; primitives often share one and only differ by their index ranges
+        std::vector<gltf_document::primitive const *> vertex_sets;
+        std::vector<unsigned int> vertex_set_of;
+        for (auto const * primitive : primitives) {
+            auto same_vertices = [&](auto const * other){ return vertex_attributes(*other) == vertex_attributes(*primitive); };
+            auto it = std::find_if(vertex_sets.begin(), vertex_sets.end(), same_vertices);
+            vertex_set_of.push_back(it - vertex_sets.begin());
+            if (it == vertex_sets.end())
+                vertex_sets.push_back(primitive);
+        }
+
+        auto const & first = *primitives[0];
+        std::array<gltf_model::accessor *, 5> const targets{&result_mesh.position, &result_mesh.normal, &result_mesh.texcoord, &result_mesh.joints, &result_mesh.weights};
+        std::vector<unsigned int> base_vertex(vertex_sets.size(), 0);
+
+        if (vertex_sets.size() == 1) {
+            auto const attributes = vertex_attributes(first);
+            for (std::size_t i = 0; i < attributes.size(); ++i)
+                if (attributes[i] != -1)
+                    *targets[i] = parse_accessor(attributes[i]);
+        } else {
+            unsigned int vertex_count = 0;
+            for (std::size_t s = 0; s < vertex_sets.size(); ++s) {
+                base_vertex[s] = vertex_count;
+                vertex_count += document.accessors.at(vertex_sets[s]->position).count;
+            }
 
-        auto const &attributes = primitives[0]["attributes"];
+            auto const attributes = vertex_attributes(first);
+            for (std::size_t i = 0; i < attributes.size(); ++i) {
+                if (attributes[i] == -1) continue;
+                auto const & format = document.accessors.at(attributes[i]);
+                auto const element_size = component_size(format.component_type) * format.size;
 
-        result_mesh.indices = parse_accessor(primitives[0]["indices"].GetInt());
-        result_mesh.position = parse_accessor(attributes["POSITION"].GetInt());
-        result_mesh.normal = parse_accessor(attributes["NORMAL"].GetInt());
-        result_mesh.texcoord = parse_accessor(attributes["TEXCOORD_0"].GetInt());
+                auto view = generate(std::size_t(vertex_count) * element_size);
+                for (std::size_t s = 0; s < vertex_sets.size(); ++s)
+                    copy_elements(parse_accessor(vertex_attributes(*vertex_sets[s])[i]), generated_data(view) + base_vertex[s] * element_size);
 
-        result_mesh.is_rigged = false;
-        if (attributes.HasMember("JOINTS_0")) {
-            result_mesh.is_rigged = true;
-            result_mesh.joints = parse_accessor(attributes["JOINTS_0"].GetInt());
-            result_mesh.weights = parse_accessor(attributes["WEIGHTS_0"].GetInt());
+                *targets[i] = {view, format.component_type, format.size, vertex_count, 0, format.normalized};
+            }
         }
 
-        std::tie(result_mesh.min, result_mesh.max) = parse_bounds(attributes["POSITION"].GetInt());
+        if (primitives.size() == 1 && first.indices != -1) {
+            result_mesh.indices = parse_accessor(first.indices);
+            return;
+        }
 
-        auto const &material = document["materials"].GetArray()[primitives[0]["material"].GetInt()];
+        // Index ranges that already follow each other in memory are merged without copying
+        if (vertex_sets.size() == 1 && std::all_of(primitives.begin(), primitives.end(), [](auto const * p){ return p->indices != -1; })) {
+            auto merged = parse_accessor(first.indices);
+            bool contiguous = true;
+            for (std::size_t p = 1; p < primitives.size() && contiguous; ++p) {
+                auto const next = parse_accessor(primitives[p]->indices);
+                contiguous = next.type == merged.type && next.view.buffer == merged.view.buffer
+                             && result.data(next) == result.data(merged) + merged.count * component_size(merged.type);
+                merged.count += next.count;
+            }
+            if (contiguous) {
+                // The range may now extend past the first view, which only matters for its byte size
+                merged.view.size = merged.offset + merged.count * component_size(merged.type);
+                result_mesh.indices = merged;
+                return;
+            }
+        }
 
-        result_mesh.material.two_sided = material.HasMember("doubleSided") && material["doubleSided"].GetBool();
-        result_mesh.material.transparent =
-                material.HasMember("alphaMode") && (material["alphaMode"].GetString() == std::string("BLEND"));
+        unsigned int index_count = 0;
+        for (auto const * primitive : primitives)
+            index_count += document.accessors.at(primitive->indices != -1 ? primitive->indices : primitive->position).count;
 
-        auto const &pbr = material["pbrMetallicRoughness"];
-        if (pbr.HasMember("baseColorTexture"))
-            result_mesh.material.texture_path = parse_texture(pbr["baseColorTexture"]["index"].GetInt());
-        else if (pbr.HasMember("baseColorFactor"))
-            result_mesh.material.color = parse_color(pbr["baseColorFactor"].GetArray());
+        auto view = generate(std::size_t(index_count) * sizeof(std::uint32_t));
+        auto destination = reinterpret_cast<std::uint32_t *>(generated_data(view));
+        for (std::size_t p = 0; p < primitives.size(); ++p) {
+            auto const base = base_vertex[vertex_set_of[p]];
+            if (primitives[p]->indices == -1) {
+                auto const count = document.accessors.at(primitives[p]->position).count;
+                for (unsigned int i = 0; i < count; ++i)
+                    *destination++ = base + i;
+                continue;
+            }
+            auto const indices = parse_accessor(primitives[p]->indices);
+            for (unsigned int i = 0; i < indices.count; ++i)
+                *destination++ = base + read_index(indices, i);
+        }
+        result_mesh.indices = {view, 0x1405, 1, index_count, 0}; // GL_UNSIGNED_INT
+    };
 
-        //TODO? for metallicRoughness map
-        if (pbr.HasMember("metallicFactor")) {
-            result_mesh.material.metallicFactor = pbr["metallicFactor"].GetFloat();
+    for (auto const & mesh : document.meshes) {
+        // One draw per material and vertex layout, in order of first appearance
+        std::vector<std::vector<gltf_document::primitive const *>> groups;
+        for (auto const & primitive : mesh.primitives) {
+            auto same_draw = [&](auto const & group){
+                return group[0]->material == primitive.material && vertex_layout(*group[0]) == vertex_layout(primitive);
+            };
+            auto it = std::find_if(groups.begin(), groups.end(), same_draw);
+            if (it == groups.end())
+                groups.push_back({&primitive});
+            else
+                it->push_back(&primitive);
         }
-        if (pbr.HasMember("roughnessFactor")) {
-            result_mesh.material.roughnessFactor = pbr["roughnessFactor"].GetFloat();
+
+        for (auto const & group : groups) {
+            auto &result_mesh = result.meshes.emplace_back();
+            result_mesh.name = mesh.name;
+
+            merge_primitives(group, result_mesh);
+            result_mesh.is_rigged = group[0]->joints != -1;
+
+            result_mesh.min = glm::vec3(std::numeric_limits<float>::infinity());
+            result_mesh.max = glm::vec3(-std::numeric_limits<float>::infinity());
+            for (auto const * primitive : group) {
+                result_mesh.min = glm::min(result_mesh.min, document.accessors.at(primitive->position).min);
+                result_mesh.max = glm::max(result_mesh.max, document.accessors.at(primitive->position).max);
+            }
+
+            auto const material = (group[0]->material != -1) ? document.materials.at(group[0]->material) : gltf_document::material{};
+
+            result_mesh.material.two_sided = material.double_sided;
+            result_mesh.material.transparent = material.blend;
+
+            if (material.base_color_texture != -1)
+                parse_texture(material.base_color_texture, result_mesh.material);
+            else if (material.base_color_factor)
+                result_mesh.material.color = material.base_color_factor;
+
+            //TODO? for metallicRoughness map
+            result_mesh.material.metallicFactor = material.metallic_factor;
+            result_mesh.material.roughnessFactor = material.roughness_factor;
         }
     }
 
-    if (document.HasMember("skins")) {
-        auto skins = document["skins"].GetArray();
-        assert(skins.Size() == 1);
+    if (!generated->empty()) {
+        result.buffers.emplace_back(generated->data(), generated->size());
+        result.storage.push_back(std::move(generated));
+    }
+
+    if (!document.skins.empty()) {
+        assert(document.skins.size() == 1);
+        auto const & skin = document.skins[0];
         {
+            // Converts elements to floats, dequantizing normalized integers (KHR_mesh_quantization)
+            auto convert_elements = [&](gltf_model::accessor const &accessor, std::size_t components, float *destination) {
+                auto const element_size = component_size(accessor.type) * components;
+                auto const stride = accessor.view.stride ? accessor.view.stride : element_size;
+                auto const source = result.data(accessor);
+                for (unsigned int i = 0; i < accessor.count; ++i)
+                    for (std::size_t c = 0; c < components; ++c)
+                        *destination++ = read_component(source + i * stride + c * component_size(accessor.type), accessor.type, accessor.normalized);
+            };
+
+            auto is_packed_float = [](gltf_model::accessor const &accessor, std::size_t components) {
+                return accessor.type == 0x1406 && (accessor.view.stride == 0 || accessor.view.stride == components * sizeof(float)); // GL_FLOAT
+            };
+
             auto fill_buffer = [&](auto &vector, gltf_model::accessor const &accessor) {
-                assert(accessor.type == 0x1406); // GL_FLOAT
-                assert(accessor.view.stride == 0 || sizeof(vector[0]) == accessor.view.stride);
                 using value_type = std::decay_t<decltype(vector[0])>;
-                assert(accessor.size == 0 || sizeof(value_type) == sizeof(GLfloat) * accessor.size);
-                auto begin = reinterpret_cast<value_type const *>(result.buffer.data() + accessor.view.offset + accessor.offset);
-                vector.assign(begin, begin + accessor.count);
+                assert(sizeof(value_type) == sizeof(float) * accessor.size);
+                vector.resize(accessor.count);
+                convert_elements(accessor, accessor.size, reinterpret_cast<float *>(vector.data()));
+            };
+
+            // Keys that are not tightly packed floats are converted once into an extra buffer, in place of
+            // one vector per channel; the size is known upfront so the views into it stay valid
+            auto keys = std::make_shared<std::vector<float>>();
+            struct converted_range
+            {
+                std::size_t offset;
+                bool done = false;
             };
+            std::unordered_map<int, converted_range> converted_keys;
+            {
+                std::size_t keys_size = 0;
+                for (auto const &animation: document.animations)
+                    for (auto const &sampler: animation.samplers)
+                        for (int index : {sampler.input, sampler.output}) {
+                            auto const accessor = parse_accessor(index);
+                            if (!is_packed_float(accessor, accessor.size) && converted_keys.emplace(index, converted_range{keys_size}).second)
+                                keys_size += std::size_t(accessor.count) * accessor.size;
+                        }
+                keys->resize(keys_size);
+            }
 
-            auto fix_rotations = [](std::vector<glm::quat> &rotations) {
-                for (auto &r: rotations) {
-                    r = glm::quat(r.z, r.w, r.x, r.y);
+            auto view_keys = [&](auto &span, int index) {
+                using value_type = std::remove_const_t<typename std::decay_t<decltype(span)>::element_type>;
+                auto const accessor = parse_accessor(index);
+                assert(sizeof(value_type) == sizeof(float) * accessor.size);
+                if (is_packed_float(accessor, accessor.size)) {
+                    span = {reinterpret_cast<value_type const *>(result.data(accessor)), accessor.count};
+                    return;
                 }
+                auto &range = converted_keys.at(index);
+                auto const destination = keys->data() + range.offset;
+                if (!std::exchange(range.done, true))
+                    convert_elements(accessor, accessor.size, destination);
+                span = {reinterpret_cast<value_type const *>(destination), accessor.count};
             };
 
-            auto joints = skins[0]["joints"].GetArray();
+            auto const & joints = skin.joints;
 
-            std::vector<glm::mat4> inverse_bind_matrices(joints.Size());
+            std::vector<glm::mat4> inverse_bind_matrices(joints.size());
 
-            fill_buffer(inverse_bind_matrices, parse_accessor(skins[0]["inverseBindMatrices"].GetInt()));
+            fill_buffer(inverse_bind_matrices, parse_accessor(skin.inverse_bind_matrices));
 
-            result.bones.resize(joints.Size());
+            result.bones.resize(joints.size());
 
             std::unordered_map<int, int> bone_node_to_index;
-            for (int i = 0; i < joints.Size(); ++i) {
-                int const node_id = joints[i].GetInt();
-                bone_node_to_index[node_id] = i;
-                result.bones[i].name = document["nodes"].GetArray()[node_id]["name"].GetString();
+            for (std::size_t i = 0; i < joints.size(); ++i) {
+                int const node_id = joints[i];
+                bone_node_to_index[node_id] = static_cast<int>(i);
+                result.bones[i].name = document.nodes.at(node_id).name;
                 result.bones[i].inverse_bind_matrix = inverse_bind_matrices[i];
             }
 
-            auto nodes = document["nodes"].GetArray();
-
-            for (int i = 0; i < nodes.Size(); ++i) {
-                if (!bone_node_to_index.contains(i)) continue;
-
-                auto const &node = nodes[i];
+            auto const & nodes = document.nodes;
 
-                if (!node.HasMember("children")) continue;
+            for (std::size_t i = 0; i < nodes.size(); ++i) {
+                if (!bone_node_to_index.contains(static_cast<int>(i))) continue;
 
-                for (auto const &child: node["children"].GetArray()) {
-                    int child_id = child.GetInt();
+                for (int child_id : nodes[i].children) {
                     if (bone_node_to_index.contains(child_id))
-                        result.bones[bone_node_to_index.at(child_id)].parent = bone_node_to_index.at(i);
+                        result.bones[bone_node_to_index.at(child_id)].parent = bone_node_to_index.at(static_cast<int>(i));
                 }
             }
 
-            for (int i = 0; i < result.bones.size(); ++i)
-                assert(result.bones[i].parent == -1 || result.bones[i].parent < i);
-
-            for (auto const &animation: document["animations"].GetArray()) {
-                std::string name = animation["name"].GetString();
-
-                auto samplers = animation["samplers"].GetArray();
+            for (unsigned int i = 0; i < result.bones.size(); ++i)
+                assert(result.bones[i].parent == gltf_model::bone::no_parent || result.bones[i].parent < i);
 
+            for (auto const &animation: document.animations) {
                 gltf_model::animation result_animation;
                 result_animation.bones.resize(result.bones.size());
 
-                for (auto const &channel: animation["channels"].GetArray()) {
-                    int node_id = channel["target"]["node"].GetInt();
-                    if (!bone_node_to_index.contains(node_id)) continue;
-
-                    auto &bone = result_animation.bones[bone_node_to_index.at(node_id)];
+                for (auto const &channel: animation.channels) {
+                    if (!bone_node_to_index.contains(channel.node)) continue;
 
-                    std::string path = channel["target"]["path"].GetString();
+                    auto &bone = result_animation.bones[bone_node_to_index.at(channel.node)];
 
-                    auto const &sampler = samplers[channel["sampler"].GetInt()];
+                    auto const &sampler = animation.samplers.at(channel.sampler);
 
-                    auto input = parse_accessor(sampler["input"].GetInt());
-                    auto output = parse_accessor(sampler["output"].GetInt());
-
-                    if (path == "translation") {
-                        fill_buffer(bone.translation.timestamps, input);
-                        fill_buffer(bone.translation.values, output);
-                    } else if (path == "rotation") {
-                        fill_buffer(bone.rotation.timestamps, input);
-                        fill_buffer(bone.rotation.values, output);
-                        fix_rotations(bone.rotation.values);
-                    } else if (path == "scale") {
-                        fill_buffer(bone.scale.timestamps, input);
-                        fill_buffer(bone.scale.values, output);
+                    using channel_path = gltf_document::channel_path;
+                    if (channel.path == channel_path::translation) {
+                        view_keys(bone.translation.timestamps, sampler.input);
+                        view_keys(bone.translation.values, sampler.output);
+                    } else if (channel.path == channel_path::rotation) {
+                        view_keys(bone.rotation.timestamps, sampler.input);
+                        view_keys(bone.rotation.values, sampler.output);
+                    } else if (channel.path == channel_path::scale) {
+                        view_keys(bone.scale.timestamps, sampler.input);
+                        view_keys(bone.scale.values, sampler.output);
                     }
                 }
 
-                auto update_max_time = [&](std::vector<float> const &timestamps) {
+                auto update_max_time = [&](std::span<float const> timestamps) {
                     for (float t: timestamps)
                         result_animation.max_time = std::max(result_animation.max_time, t);
                 };
@@ -248,10 +1085,48 @@ gltf_model load_gltf(std::filesystem::path const & path)
                     update_max_time(bone.scale.timestamps);
                 }
 
-                result.animations[std::move(name)] = std::move(result_animation);
+                result.animations[animation.name] = std::move(result_animation);
+            }
+
+            if (!keys->empty()) {
+                result.buffers.emplace_back(reinterpret_cast<char const *>(keys->data()), keys->size() * sizeof(float));
+                result.storage.push_back(std::move(keys));
             }
         }
     }
 
+    check_skeleton(result, path.string());
+
+    return result;
+}
+
+void check_skeleton(gltf_model const & model, std::string const & source)
+{
+    if (model.bones.size() > max_skeleton_bones)
+        throw std::runtime_error("Skeleton of " + std::to_string(model.bones.size()) + " bones exceeds the "
+            + std::to_string(max_skeleton_bones) + " bones a palette holds in " + source);
+
+    // A joint past the skeleton would read the palette of the next instance
+    for (auto const & mesh : model.meshes) {
+        if (!mesh.is_rigged)
+            continue;
+        for (float joint : read_accessor(model, mesh.joints))
+            if (joint >= model.bones.size())
+                throw std::runtime_error("Mesh " + mesh.name + " uses joint " + std::to_string(static_cast<std::size_t>(joint))
+                    + " of a skeleton of " + std::to_string(model.bones.size()) + " bones in " + source);
+    }
+}
+
+std::vector<float> read_accessor(gltf_model const & model, gltf_model::accessor const & accessor)
+{
+    auto const element_size = component_size(accessor.type) * accessor.size;
+    auto const stride = accessor.view.stride ? accessor.view.stride : element_size;
+    auto const source = model.data(accessor);
+
+    std::vector<float> result;
+    result.reserve(accessor.count * accessor.size);
+    for (unsigned int i = 0; i < accessor.count; ++i)
+        for (unsigned int c = 0; c < accessor.size; ++c)
+            result.push_back(read_component(source + i * stride + c * component_size(accessor.type), accessor.type, accessor.normalized));
     return result;
 }
@@ -2,10 +2,13 @@
 
 #include <filesystem>
 #include <vector>
+#include <span>
+#include <memory>
 #include <string>
 #include <optional>
 #include <unordered_map>
 #include <algorithm>
+#include <type_traits>
 
 #define GLM_FORCE_SWIZZLE
 #define GLM_ENABLE_EXPERIMENTAL
@@ -14,10 +17,34 @@
 #include <glm/gtx/quaternion.hpp>
 #include <glm/gtx/compatibility.hpp>
 
+// Index of the first key at or after `time`, with `cursor` holding the key found by the previous call. Playing
+// forward steps the cursor over the few keys passed since then; seeks and wrap-arounds fall back to a search.
+template <typename Time>
+std::size_t find_keyframe(std::span<Time const> timestamps, float time, std::size_t & cursor)
+{
+    constexpr std::size_t max_steps = 4;
+
+    auto key = cursor;
+    if (key > timestamps.size() || (key > 0 && timestamps[key - 1] >= time)) {
+        key = std::lower_bound(timestamps.begin(), timestamps.end(), time) - timestamps.begin();
+    } else {
+        for (std::size_t steps = 0; key < timestamps.size() && timestamps[key] < time; ++key) {
+            if (++steps == max_steps) {
+                key = std::lower_bound(timestamps.begin() + key, timestamps.end(), time) - timestamps.begin();
+                break;
+            }
+        }
+    }
+
+    cursor = key;
+    return key;
+}
+
 struct gltf_model
 {
     struct buffer_view
     {
+        unsigned int buffer;
         unsigned int offset;
         unsigned int size;
         unsigned int stride;
@@ -30,6 +57,8 @@ struct gltf_model
         unsigned int size;
         unsigned int count;
         unsigned int offset;
+        // Integer components map to [0, 1] or [-1, 1] (KHR_mesh_quantization)
+        bool normalized = false;
     };
 
     struct material
@@ -37,25 +66,47 @@ struct gltf_model
         bool two_sided;
         bool transparent;
         std::optional<std::string> texture_path;
+        // Set when the image is stored in a buffer (e.g. inside a .glb) instead of a separate file
+        std::optional<buffer_view> texture_view;
         std::optional<glm::vec4> color;
-        float metallicFactor;
-        float roughnessFactor;
+        float metallicFactor = 1.f;
+        float roughnessFactor = 1.f;
     };
 
     struct bone
     {
-        unsigned int parent = -1;
+        // Parent of root bones
+        static constexpr unsigned int no_parent = -1;
+
+        unsigned int parent = no_parent;
         std::string name;
         glm::mat4 inverse_bind_matrix;
     };
 
+    // Keyframes are views into the model buffers, so loading animations allocates nothing per channel
     template <typename T>
     struct spline
     {
-        std::vector<float> timestamps;
-        std::vector<T> values;
-
-        T operator()(float time) const;
+        // Rotations stay in the glTF component order x, y, z, w and are reordered for glm::quat when sampled
+        using key_type = std::conditional_t<std::is_same_v<T, glm::quat>, glm::vec4, T>;
+
+        std::span<float const> timestamps;
+        std::span<key_type const> values;
+
+        T operator()(float time) const
+        {
+            return sample(time, std::lower_bound(timestamps.begin(), timestamps.end(), time) - timestamps.begin());
+        }
+
+        // Same as operator()(time), with the key search cached in `cursor`, see find_keyframe
+        T operator()(float time, std::size_t & cursor) const
+        {
+            return sample(time, find_keyframe(timestamps, time, cursor));
+        }
+
+    private:
+        // `key` is the first one at or after `time`
+        T sample(float time, std::size_t key) const;
     };
 
     struct bone_animation
@@ -65,6 +116,14 @@ struct gltf_model
         spline<glm::vec3> scale;
     };
 
+    // Cursors of one playing instance of an animation, see spline::operator()(float, std::size_t &)
+    struct bone_cursor
+    {
+        std::size_t translation = 0;
+        std::size_t rotation = 0;
+        std::size_t scale = 0;
+    };
+
     struct animation
     {
         std::vector<bone_animation> bones;
@@ -86,48 +145,73 @@ struct gltf_model
         glm::vec3 max;
 
         bool is_rigged;
-        accessor joints;
-        accessor weights;
+        accessor joints{};
+        accessor weights{};
     };
 
-    std::vector<char> buffer;
+    // Owners of the memory the buffers point into: file contents or the whole .glb container
+    std::vector<std::shared_ptr<void const>> storage;
+    std::vector<std::span<char const>> buffers;
     std::vector<mesh> meshes;
     std::vector<bone> bones;
     std::unordered_map<std::string, animation> animations;
+
+    char const * data(buffer_view const & view) const
+    {
+        return buffers[view.buffer].data() + view.offset;
+    }
+
+    char const * data(accessor const & accessor) const
+    {
+        return data(accessor.view) + accessor.offset;
+    }
+};
+
+enum class gltf_buffer_mode
+{
+    // Buffers are read into owned memory
+    read,
+    // Buffers are read-only memory mappings of the files, so the page cache is the only copy
+    map,
 };
 
-gltf_model load_gltf(std::filesystem::path const & path);
+gltf_model load_gltf(std::filesystem::path const & path, gltf_buffer_mode mode = gltf_buffer_mode::map);
+
+// Bones a skeleton may have. Meshes aren't split into smaller palettes: a draw reads its whole skeleton from one
+// frame of bone_palette_ring, which must fit the 65536 texels GL 3.3 guarantees a texture buffer, split in three
+// frames at up to three texels per bone.
+constexpr std::size_t max_skeleton_bones = 65536 / 3 / 3;
+
+// Throws if the skeleton of `model` has more than max_skeleton_bones bones or a rigged mesh uses a joint past it;
+// `source` names the model in the message
+void check_skeleton(gltf_model const & model, std::string const & source);
+
+// Components of every element of `accessor` converted to floats, `accessor.size` per element, with normalized
+// integers dequantized; for processing mesh data on the CPU
+std::vector<float> read_accessor(gltf_model const & model, gltf_model::accessor const & accessor);
 
 template <>
-inline glm::vec3 gltf_model::spline<glm::vec3>::operator()(float time) const
+inline glm::vec3 gltf_model::spline<glm::vec3>::sample(float time, std::size_t i) const
 {
     assert(!values.empty());
 
-    auto it = std::lower_bound(timestamps.begin(), timestamps.end(), time);
-    if (it == timestamps.begin())
-        return values.back();
-    if (it == timestamps.end())
+    if (i == 0 || i == timestamps.size())
         return values.back();
 
-    int i = it - timestamps.begin();
-
     float t = (time - timestamps[i - 1]) / (timestamps[i] - timestamps[i - 1]);
     return glm::lerp(values[i - 1], values[i], t);
 }
 
 template <>
-inline glm::quat gltf_model::spline<glm::quat>::operator()(float time) const
+inline glm::quat gltf_model::spline<glm::quat>::sample(float time, std::size_t i) const
 {
     assert(!values.empty());
 
-    auto it = std::lower_bound(timestamps.begin(), timestamps.end(), time);
-    if (it == timestamps.begin())
-        return values.back();
-    if (it == timestamps.end())
-        return values.back();
+    auto key = [](glm::vec4 const & v){ return glm::quat(v.w, v.x, v.y, v.z); };
 
-    int i = it - timestamps.begin();
+    if (i == 0 || i == timestamps.size())
+        return key(values.back());
 
     float t = (time - timestamps[i - 1]) / (timestamps[i] - timestamps[i - 1]);
-    return glm::slerp(values[i - 1], values[i], t);
+    return glm::slerp(key(values[i - 1]), key(values[i]), t);
 }
@@ -14,6 +14,13 @@
 #include <vector>
 #include <random>
 #include <map>
+#include <limits>
+#include <array>
+#include <memory>
+#include <functional>
+#include <future>
+#include <initializer_list>
+#include <tuple>
 #include <cmath>
 
 #define GLM_FORCE_SWIZZLE
@@ -27,6 +34,18 @@
 #include <glm/gtx/string_cast.hpp>
 
 #include "gltf_loader.hpp"
+#include "animation_compression.hpp"
+#include "animation_graph.hpp"
+#include "skeleton.hpp"
+#include "bone_palette.hpp"
+#include "cpu_skinning.hpp"
+#include "baked_animation.hpp"
+#include "geometry_arena.hpp"
+#include "skinned_mesh_cache.hpp"
+#include "vertex_animation.hpp"
+#include "scene_pack.hpp"
+#include "thread_pool.hpp"
+#include "upload_queue.hpp"
 #include "stb_image.h"
 #include "shaders.h"
 #include "frustum.hpp"
@@ -36,6 +55,47 @@
 
 const int LEVELS_DETAILS = 6;
 
+// Renders the coarsest padoru LOD and low texture mips right away and streams the rest in while running
+const bool PROGRESSIVE_LOADING = true;
+// Texture levels up to this size are uploaded before the first frame when loading progressively
+const int FIRST_STREAMED_LEVEL_SIZE = 128;
+// Time spent on streamed uploads per frame
+const std::chrono::duration<float, std::milli> UPLOAD_BUDGET{2.f};
+enum class animation_storage
+{
+    splines,
+    // Resampled at ANIMATION_FRAME_RATE, fastest to sample
+    baked,
+    // Keys reduced and quantized within the default error bounds of compress_animation, smallest
+    compressed,
+};
+// What the bird animations are sampled from
+const animation_storage ANIMATION_STORAGE = animation_storage::compressed;
+const float ANIMATION_FRAME_RATE = 60.f;
+// How bone palettes are stored and blended in the vertex shader
+const skinning_mode SKINNING_MODE = skinning_mode::linear;
+// The bird is skinned once per frame by transform feedback, its passes then draw it as static geometry
+const bool SKIN_ONCE = true;
+// Sparrows drawn with one instanced draw per mesh, each at its own animation phase, 0 disables the crowd
+const int SPARROW_CROWD_SIZE = 1024;
+// Crowd sparrows farther than this from the camera play their idle animation from a vertex_animation
+// instead of being posed and skinned
+const float VERTEX_ANIMATION_DISTANCE = 20.f;
+// Animation levels of detail of the near crowd, largest on screen first: a sparrow spanning at least
+// `screen_size` of the screen height is posed every `update_interval` seconds, interpolated in between,
+// with bones at most `bone_depth` below the root. The last level takes all smaller sparrows.
+struct animation_lod
+{
+    float screen_size;
+    float update_interval;
+    std::size_t bone_depth;
+};
+const animation_lod ANIMATION_LODS[] = {
+    {0.2f, 0.f, std::numeric_limits<std::size_t>::max()},
+    {0.1f, 1.f / 30.f, std::numeric_limits<std::size_t>::max()},
+    {0.f, 1.f / 15.f, 2},
+};
+
 std::string to_string(std::string_view str)
 {
     return std::string(str.begin(), str.end());
@@ -51,29 +111,66 @@ void glew_fail(std::string_view message, GLenum error)
     throw std::runtime_error(to_string(message) + reinterpret_cast<const char *>(glewGetErrorString(error)));
 }
 
-GLuint load_texture(std::string const & path)
+GLuint upload_texture(texture_data const & texture)
 {
-    int width, height, channels;
-    auto pixels = stbi_load(path.data(), &width, &height, &channels, 4);
-
     GLuint result;
     glGenTextures(1, &result);
     glBindTexture(GL_TEXTURE_2D, result);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    for (size_t level = 0; level < texture.levels.size(); ++level) {
+        auto const & data = texture.levels[level];
+        glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, data.width, data.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data.pixels.data());
+    }
+    if (texture.levels.size() == 1)
+        glGenerateMipmap(GL_TEXTURE_2D);
+    return result;
+}
+
+// Texture of one grey texel, standing in for a texture whose levels are still being loaded
+GLuint create_placeholder_texture()
+{
+    GLuint result;
+    glGenTextures(1, &result);
+    glBindTexture(GL_TEXTURE_2D, result);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glGenerateMipmap(GL_TEXTURE_2D);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    unsigned char const grey[] = {128, 128, 128, 255};
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+    return result;
+}
 
-    stbi_image_free(pixels);
+// Uploads the coarse levels of a mip chain into a placeholder texture at once and queues the finer ones,
+// one level per upload. Every upload lowers the base level, so the texture is complete at all times.
+void stream_texture(GLuint texture, std::shared_ptr<texture_data const> data, upload_queue & uploads)
+{
+    auto upload_level = [texture, data](int level)
+    {
+        auto const & image = data->levels[level];
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, image.width, image.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image.pixels.data());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+    };
 
-    return result;
+    int const last = data->levels.size() - 1;
+    int first = last;
+    while (first > 0 && std::max(data->levels[first - 1].width, data->levels[first - 1].height) <= FIRST_STREAMED_LEVEL_SIZE)
+        --first;
+
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, last == 0 ? 1000 : last);
+    for (int level = last; level >= first; --level)
+        upload_level(level);
+    if (last == 0)
+        glGenerateMipmap(GL_TEXTURE_2D);
+
+    for (int level = first - 1; level >= 0; --level)
+        uploads.push([upload_level, level]{ upload_level(level); });
 }
 
-template <typename ... Shaders>
-GLuint create_program(Shaders ... shaders)
+void link_program(GLuint result)
 {
-    GLuint result = glCreateProgram();
-    (glAttachShader(result, shaders), ...);
     glLinkProgram(result);
 
     GLint status;
@@ -86,26 +183,44 @@ GLuint create_program(Shaders ... shaders)
         glGetProgramInfoLog(result, info_log.size(), nullptr, info_log.data());
         throw std::runtime_error("Program linkage failed: " + info_log);
     }
+}
 
+template <typename ... Shaders>
+GLuint create_program(Shaders ... shaders)
+{
+    GLuint result = glCreateProgram();
+    (glAttachShader(result, shaders), ...);
+    link_program(result);
     return result;
 }
 
-glm::vec3 get_or_default_translation(const gltf_model::spline<glm::vec3>& spline, float time) {
+// A program without fragment shader capturing `varyings` interleaved into one transform feedback buffer
+GLuint create_transform_feedback_program(std::initializer_list<GLuint> shaders, std::initializer_list<char const *> varyings)
+{
+    GLuint result = glCreateProgram();
+    for (auto shader : shaders)
+        glAttachShader(result, shader);
+    glTransformFeedbackVaryings(result, varyings.size(), std::data(varyings), GL_INTERLEAVED_ATTRIBS);
+    link_program(result);
+    return result;
+}
+
+glm::vec3 get_or_default_translation(const gltf_model::spline<glm::vec3>& spline, float time, std::size_t& cursor) {
     if (spline.values.empty())
         return glm::vec3(0);
-    return spline(time);
+    return spline(time, cursor);
 }
 
-glm::vec3 get_or_default_scale(const gltf_model::spline<glm::vec3>& spline, float time) {
+glm::vec3 get_or_default_scale(const gltf_model::spline<glm::vec3>& spline, float time, std::size_t& cursor) {
     if (spline.values.empty())
         return glm::vec3(1);
-    return spline(time);
+    return spline(time, cursor);
 }
 
-glm::quat get_or_default_rotation(const gltf_model::spline<glm::quat>& spline, float time) {
+glm::quat get_or_default_rotation(const gltf_model::spline<glm::quat>& spline, float time, std::size_t& cursor) {
     if (spline.values.empty())
         return {1, 0, 0, 0};
-    return spline(time);
+    return spline(time, cursor);
 }
 
 static glm::vec3 cube_vertices[]
@@ -200,7 +315,8 @@ int main() try
 
     auto vertex_shader = create_shader(GL_VERTEX_SHADER, vertex_shader_source);
     auto fragment_shader = create_shader(GL_FRAGMENT_SHADER, fragment_shader_source);
-    auto program = create_program(vertex_shader, fragment_shader);
+    auto skinning_shader = create_shader(GL_VERTEX_SHADER, skinning_shader_source);
+    auto program = create_program(vertex_shader, skinning_shader, fragment_shader);
 
     GLuint model_location = glGetUniformLocation(program, "model");
     GLuint view_location = glGetUniformLocation(program, "view");
@@ -209,17 +325,40 @@ int main() try
     GLuint color_location = glGetUniformLocation(program, "color");
     GLuint use_texture_location = glGetUniformLocation(program, "use_texture");
     GLuint light_direction_location = glGetUniformLocation(program, "light_direction");
-    GLuint bones_location = glGetUniformLocation(program, "bones");
     GLuint camera_position_location = glGetUniformLocation(program, "camera_position");
     GLuint is_rigged_location = glGetUniformLocation(program, "is_rigged");
     GLuint roughness_location = glGetUniformLocation(program, "roughness");
     GLuint is_instance_location = glGetUniformLocation(program, "is_instance");
     GLuint instance_turn_location = glGetUniformLocation(program, "instance_turn");
+    GLuint bone_palette_location = glGetUniformLocation(program, "bone_palette");
+    GLuint palette_offset_location = glGetUniformLocation(program, "palette_offset");
+    GLuint palette_bone_count_location = glGetUniformLocation(program, "palette_bone_count");
+    GLuint dual_quaternion_skinning_location = glGetUniformLocation(program, "dual_quaternion_skinning");
+    GLuint use_vertex_animation_location = glGetUniformLocation(program, "use_vertex_animation");
+    GLuint vertex_animation_positions_location = glGetUniformLocation(program, "vertex_animation_positions");
+    GLuint vertex_animation_normals_location = glGetUniformLocation(program, "vertex_animation_normals");
+    GLuint vertex_animation_vertex_count_location = glGetUniformLocation(program, "vertex_animation_vertex_count");
+    GLuint vertex_animation_frame_count_location = glGetUniformLocation(program, "vertex_animation_frame_count");
+    GLuint vertex_animation_frame_rate_location = glGetUniformLocation(program, "vertex_animation_frame_rate");
+    GLuint vertex_animation_duration_location = glGetUniformLocation(program, "vertex_animation_duration");
+    GLuint vertex_animation_base_vertex_location = glGetUniformLocation(program, "vertex_animation_base_vertex");
+    GLuint time_location = glGetUniformLocation(program, "time");
+
+    auto vertex_shader_skinning = create_shader(GL_VERTEX_SHADER, vertex_shader_skinning_source);
+    auto skinning_program = create_transform_feedback_program({vertex_shader_skinning, skinning_shader},
+                                                              {"skinned_position", "skinned_normal"});
+    GLuint skinning_bone_palette_location = glGetUniformLocation(skinning_program, "bone_palette");
+    GLuint skinning_palette_offset_location = glGetUniformLocation(skinning_program, "palette_offset");
+    GLuint skinning_palette_bone_count_location = glGetUniformLocation(skinning_program, "palette_bone_count");
+    GLuint skinning_dual_quaternion_skinning_location = glGetUniformLocation(skinning_program, "dual_quaternion_skinning");
+
+    GLuint vbo_instance_times;
+    glGenBuffers(1, &vbo_instance_times);
 
 
     const std::string project_root = PROJECT_ROOT;
 
-    GLuint environment_texture = load_texture(project_root + "/textures/environments/environment_map.jpg");
+    auto loading_start = std::chrono::high_resolution_clock::now();
 
     const int N_MODELS = 3;
     const std::string model_path[] = {
@@ -227,85 +366,106 @@ int main() try
             project_root + "/models/sparrow_-_quirky_series/scene.gltf",
             project_root + "/models/disco_ball/scene.gltf"
     };
+
+    // Streamed-in data waiting to be uploaded on this thread between frames. Declared before the pool,
+    // as workers push into it until they are joined.
+    upload_queue uploads;
+    std::map<std::string, GLuint> textures[N_MODELS];
+
+    // Parsing and decoding run on the workers, only the uploads below happen on this thread
+    thread_pool pool;
+
+    auto environment_data = pool.submit([&]{
+        return load_texture_data(project_root + "/textures/environments/environment_map.jpg");
+    });
+
+    // Baked packs next to the models are used when fresh and rebaked otherwise
+    std::vector<std::filesystem::path> const model_paths(std::begin(model_path), std::end(model_path));
+    auto scenes = !PROGRESSIVE_LOADING
+            ? load_scenes(model_paths, pool)
+            : load_scenes(model_paths, pool, [&uploads, &textures](std::size_t scene, std::string const & key, texture_data const & texture) {
+                uploads.push([&uploads, &textures, scene, key, data = std::make_shared<texture_data const>(texture)]{
+                    // Textures of meshes dropped after loading have no placeholder and are not drawn
+                    auto it = textures[scene].find(key);
+                    if (it != textures[scene].end())
+                        stream_texture(it->second, data, uploads);
+                });
+            });
+    GLuint environment_texture = upload_texture(environment_data.get());
+
     gltf_model  input_model[] = { ///REMOVE CONST, maybe it's dangerous //!!!!!!!!!!!!!!!!!!!!!!!!
-            load_gltf(model_path[0]),
-            load_gltf(model_path[1]),
-            load_gltf(model_path[2])
+            std::move(scenes[0].model),
+            std::move(scenes[1].model),
+            std::move(scenes[2].model)
     };
     input_model[2].meshes.pop_back(); ///Only discoball
 
     struct mesh
     {
-        GLuint vao;
-        gltf_model::accessor indices;
+        geometry_arena::draw_range const * range;
         gltf_model::material material;
+        // Drawn instead of `range` by non-instanced draws once resident, see skinned_mesh_cache
+        geometry_arena::draw_range const * skinned_range = nullptr;
     };
 
-    GLuint vbo[N_MODELS];
-    glGenBuffers(N_MODELS, vbo);
-
-    std::vector<mesh> meshes[N_MODELS];
-    std::map<std::string, GLuint> textures[N_MODELS];
+    geometry_arena arena(input_model);
 
+    // The padoru meshes are its LODs, finest first. When loading progressively only the coarsest one is
+    // uploaded now; the others are staged on the workers and uploaded from coarse to fine.
     for (int idx_model = 0; idx_model < N_MODELS; ++idx_model) {
-        glBindBuffer(GL_ARRAY_BUFFER, vbo[idx_model]);
-        glBufferData(GL_ARRAY_BUFFER, input_model[idx_model].buffer.size(), input_model[idx_model].buffer.data(), GL_STATIC_DRAW);
-
-        auto setup_attribute = [](int index, gltf_model::accessor const & accessor, bool integer = false)
-        {
-            glEnableVertexAttribArray(index);
-            if (integer)
-                glVertexAttribIPointer(index, accessor.size, accessor.type, accessor.view.stride, reinterpret_cast<void *>(accessor.view.offset + accessor.offset));
-            else
-                glVertexAttribPointer(index, accessor.size, accessor.type, GL_FALSE, accessor.view.stride, reinterpret_cast<void *>(accessor.view.offset + accessor.offset));
-        };
+        for (size_t i = 0; i < input_model[idx_model].meshes.size(); ++i)
+            if (!PROGRESSIVE_LOADING || idx_model != 0 || i + 1 == input_model[idx_model].meshes.size())
+                arena.upload(arena.stage(input_model[idx_model], idx_model, i));
+    }
+    // Waited for before the arena goes away, also when leaving through an exception: the pool outlives the arena
+    std::vector<std::future<void>> lod_staging;
+    struct staging_wait
+    {
+        std::vector<std::future<void>> & staging;
 
-        glBindBuffer(GL_ARRAY_BUFFER, vbo[idx_model]);
-        for (auto const & mesh : input_model[idx_model].meshes)
+        ~staging_wait()
         {
-            auto & result = meshes[idx_model].emplace_back();
-            glGenVertexArrays(1, &result.vao);
-            glBindVertexArray(result.vao);
-
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vbo[idx_model]);
-            result.indices = mesh.indices;
-
-            setup_attribute(0, mesh.position);
-            setup_attribute(1, mesh.normal);
-            setup_attribute(2, mesh.texcoord);
-            setup_attribute(3, mesh.joints, true);
-            setup_attribute(4, mesh.weights);
-            glEnableVertexAttribArray(5);
-
-            result.material = mesh.material;
+            for (auto & task : staging)
+                if (task.valid())
+                    task.wait();
         }
+    } lod_staging_wait{lod_staging};
+    if (PROGRESSIVE_LOADING) {
+        for (size_t i = input_model[0].meshes.size() - 1; i-- > 0;)
+            lod_staging.push_back(pool.submit([&arena, &uploads, &model = input_model[0], i]{
+                auto staged = std::make_shared<geometry_arena::staged_mesh>(arena.stage(model, 0, i));
+                uploads.push([&arena, staged]{ arena.upload(*staged); });
+            }));
+    }
 
+    std::vector<mesh> meshes[N_MODELS];
 
-        for (auto const & mesh : meshes[idx_model])
-        {
-            if (!mesh.material.texture_path) continue;
-            if (textures[idx_model].contains(*mesh.material.texture_path)) continue;
-
-            auto path = std::filesystem::path(model_path[idx_model]).parent_path() / *mesh.material.texture_path;
-
-            int width, height, channels;
-            auto data = stbi_load(path.c_str(), &width, &height, &channels, 4);
-            assert(data);
+    for (int idx_model = 0; idx_model < N_MODELS; ++idx_model) {
+        auto const & model = input_model[idx_model];
 
-            GLuint texture;
-            glGenTextures(1, &texture);
-            glBindTexture(GL_TEXTURE_2D, texture);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-            glGenerateMipmap(GL_TEXTURE_2D);
+        for (size_t i = 0; i < model.meshes.size(); ++i)
+            meshes[idx_model].push_back({&arena.ranges[idx_model][i], model.meshes[i].material});
 
-            stbi_image_free(data);
+        if (!PROGRESSIVE_LOADING) {
+            for (auto const & [path, texture] : scenes[idx_model].textures)
+                textures[idx_model][path] = upload_texture(texture);
+            continue;
+        }
 
-            textures[idx_model][*mesh.material.texture_path] = texture;
+        for (auto const & mesh : model.meshes) {
+            auto const & path = mesh.material.texture_path;
+            if (!path || textures[idx_model].contains(*path))
+                continue;
+            auto texture = textures[idx_model][*path] = create_placeholder_texture();
+            if (auto it = scenes[idx_model].textures.find(*path); it != scenes[idx_model].textures.end())
+                stream_texture(texture, std::make_shared<texture_data const>(it->second), uploads);
         }
     }
 
+    std::cout << "Ready to render in "
+              << std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - loading_start).count()
+              << " ms" << std::endl;
+
     auto last_frame_start = std::chrono::high_resolution_clock::now();
 
     float time = 0.f, start_of_shift = 0.f;
@@ -339,8 +499,203 @@ int main() try
     }
     auto idle_a_bird_animation = ptr_animation->second;
 
+    baked_animation baked_spin_animation, baked_idle_a_animation;
+    if (ANIMATION_STORAGE == animation_storage::baked) {
+        baked_spin_animation = bake_animation(spin_bird_animation, ANIMATION_FRAME_RATE);
+        baked_idle_a_animation = bake_animation(idle_a_bird_animation, ANIMATION_FRAME_RATE);
+    }
+
+    compressed_animation compressed_spin_animation, compressed_idle_a_animation;
+    if (ANIMATION_STORAGE == animation_storage::compressed) {
+        compressed_spin_animation = compress_animation(spin_bird_animation);
+        compressed_idle_a_animation = compress_animation(idle_a_bird_animation);
+        std::cout << "Compressed bird animations from "
+                  << animation_memory_size(spin_bird_animation) + animation_memory_size(idle_a_bird_animation) << " to "
+                  << compressed_spin_animation.memory_size() + compressed_idle_a_animation.memory_size() << " bytes" << std::endl;
+    }
+
+    auto make_sampler = [](gltf_model::animation const & animation, baked_animation const & baked,
+        compressed_animation const & compressed, std::vector<gltf_model::bone_cursor> & cursors,
+        baked_animation::pose & baked_pose) -> animation_graph::sampler
+    {
+        return [&animation, &baked, &compressed, &cursors, &baked_pose](float time, std::span<std::size_t const> bones,
+            local_pose & pose)
+        {
+            if (ANIMATION_STORAGE == animation_storage::baked)
+                baked.sample(time, baked_pose);
+
+            for (auto i : bones) {
+                if (ANIMATION_STORAGE == animation_storage::baked) {
+                    pose.translations[i] = baked_pose.translation(i);
+                    pose.rotations[i] = baked_pose.rotation(i);
+                    pose.scales[i] = baked_pose.scale(i);
+                } else if (ANIMATION_STORAGE == animation_storage::compressed) {
+                    pose.translations[i] = compressed.translation(i, time, cursors[i].translation);
+                    pose.rotations[i] = compressed.rotation(i, time, cursors[i].rotation);
+                    pose.scales[i] = compressed.scale(i, time, cursors[i].scale);
+                } else {
+                    const auto& bone = animation.bones[i];
+                    pose.translations[i] = get_or_default_translation(bone.translation, time, cursors[i].translation);
+                    pose.rotations[i] = get_or_default_rotation(bone.rotation, time, cursors[i].rotation);
+                    pose.scales[i] = get_or_default_scale(bone.scale, time, cursors[i].scale);
+                }
+            }
+        };
+    };
+
+    // Poses birds on one thread: clips keep cursors and scratch poses, so every worker has its own graph
+    struct bird_animator
+    {
+        explicit bird_animator(gltf_model::animation const & spin, gltf_model::animation const & idle_a,
+            std::span<gltf_model::bone const> skeleton)
+            : spin_cursors(spin.bones.size())
+            , idle_cursors(idle_a.bones.size())
+            , graph(skeleton.size())
+            , skeleton(skeleton)
+        {}
+
+        std::vector<gltf_model::bone_cursor> spin_cursors, idle_cursors;
+        baked_animation::pose spin_pose, idle_a_pose;
+        animation_graph graph;
+        animation_graph::node_id idle_a_clip = 0, spin_clip = 0, blend = 0;
+        skeleton_instance skeleton;
+    };
+    // Posing has workers of its own, so that a frame never waits behind texture decoding or LOD staging
+    // queued on the loading pool
+    thread_pool animation_pool;
+
+    // Pointers, as the samplers refer to the cursors and poses of their animator
+    std::vector<std::unique_ptr<bird_animator>> bird_animators;
+    for (std::size_t i = 0; i < animation_pool.size(); ++i) {
+        auto & animator = *bird_animators.emplace_back(std::make_unique<bird_animator>(
+            spin_bird_animation, idle_a_bird_animation, input_model[1].bones));
+        animator.idle_a_clip = animator.graph.add_clip(make_sampler(idle_a_bird_animation, baked_idle_a_animation,
+            compressed_idle_a_animation, animator.idle_cursors, animator.idle_a_pose));
+        animator.spin_clip = animator.graph.add_clip([sample = make_sampler(spin_bird_animation, baked_spin_animation,
+            compressed_spin_animation, animator.spin_cursors, animator.spin_pose)](float time,
+            std::span<std::size_t const> bones, local_pose & pose)
+        {
+            sample(time, bones, pose);
+            pose.translations[0] += glm::vec3(0, -0.5, 0);
+            pose.rotations[0] = glm::rotate(pose.rotations[0], -glm::pi<float>() / 2, {1.f, 0.f, 0.f});
+        });
+        animator.blend = animator.graph.add_blend({animator.idle_a_clip, animator.spin_clip});
+    }
+
+    // Bones of the bird posed at each of ANIMATION_LODS, the others stay as at the start of the idle animation
+    std::vector<skeleton_lod> bird_skeleton_lods;
+    {
+        local_pose rest(input_model[1].bones.size());
+        sample_animation(idle_a_bird_animation, 0.f, rest);
+        for (auto const & lod : ANIMATION_LODS)
+            bird_skeleton_lods.emplace_back(input_model[1].bones, lod.bone_depth, rest);
+    }
+
+    // Writes the skinning matrices of a bird whose animations are `phase` of their length ahead
+    auto pose_bird = [&](bird_animator & animator, skeleton_lod const & lod, float time, float shift_time,
+        float interpolation, float phase, std::span<glm::mat4x3> palette)
+    {
+        animator.graph.set_time(animator.idle_a_clip, std::fmod(time + phase * idle_a_bird_animation.max_time, idle_a_bird_animation.max_time));
+        animator.graph.set_time(animator.spin_clip, std::fmod(shift_time + phase * spin_bird_animation.max_time, spin_bird_animation.max_time));
+        animator.graph.set_weight(animator.blend, 0, 1.f - interpolation);
+        animator.graph.set_weight(animator.blend, 1, interpolation);
+
+        animator.skeleton.update(animator.graph.evaluate(animator.blend, lod.bones), lod, palette);
+    };
+    // Posing of the bird and the near crowd of the current frame, waited for before their palettes are written
+    std::vector<std::future<void>> animation_jobs;
+    animation_jobs.reserve(bird_animators.size());
+
+    std::vector<glm::mat4x3> bones_matrix(input_model[1].bones.size(), glm::mat4x3(1));
+    // Bird meshes skinned on the CPU where their posed bounds are needed
+    std::vector<cpu_skinned_mesh> bird_cpu_meshes;
+    for (auto const & bird_mesh : input_model[1].meshes)
+        bird_cpu_meshes.emplace_back(input_model[1], bird_mesh);
+    // Posed bounds of the bird meshes of the current frame, written by the job posing the bird
+    std::vector<bounds> bird_bounds(bird_cpu_meshes.size());
+
     std::vector<glm::vec3> shifts[LEVELS_DETAILS]; ///For instance
 
+    // Crowd sparrows on a square grid, spaced by the bird's size and at evenly spread phases
+    std::vector<glm::vec3> crowd_shifts(SPARROW_CROWD_SIZE);
+    std::vector<float> crowd_phases(SPARROW_CROWD_SIZE);
+    std::vector<glm::mat4x3> crowd_palette(SPARROW_CROWD_SIZE * input_model[1].bones.size());
+    // Sparrows posed at a reduced rate keep their palettes at two key times and are interpolated in between
+    std::vector<glm::mat4x3> crowd_key_palettes(2 * SPARROW_CROWD_SIZE * input_model[1].bones.size());
+    std::vector<std::array<float, 2>> crowd_key_times(SPARROW_CROWD_SIZE,
+        {-std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity()});
+    // Palettes of the bird and the near crowd, bound to texture unit 1
+    bone_palette_ring bone_palettes((SPARROW_CROWD_SIZE + 1) * input_model[1].bones.size(), SKINNING_MODE);
+    // Sparrows past what the ring holds besides the bird fall back to the vertex animation. The loader keeps
+    // skeletons within max_skeleton_bones, so the bird only misses its palette on drivers below the GL minimum.
+    static_assert(max_skeleton_bones * 3 * bone_palette_ring::frames_in_flight <= 65536);
+    if (bone_palettes.capacity() < input_model[1].bones.size())
+        throw std::runtime_error("Texture buffers are too small for the bird's bone palette");
+    std::size_t const max_near_crowd = bone_palettes.capacity() / input_model[1].bones.size() - 1;
+    // The bird skinned by its palette, the crowd is still skinned per draw as its instances have their own palettes
+    skinned_mesh_cache bird_skinned(arena, arena.ranges[1]);
+    if (SKIN_ONCE)
+        for (std::size_t i = 0; i < meshes[1].size(); ++i)
+            meshes[1][i].skinned_range = &bird_skinned.ranges[i];
+    // Split every frame into the sparrows skinned near the camera and the ones playing vertex animations
+    std::vector<glm::vec3> near_crowd_shifts, far_crowd_shifts;
+    std::vector<float> far_crowd_times;
+    // Instance and index into ANIMATION_LODS of every near sparrow on screen
+    std::vector<std::size_t> near_crowd, near_crowd_lods;
+    near_crowd_shifts.reserve(SPARROW_CROWD_SIZE);
+    far_crowd_shifts.reserve(SPARROW_CROWD_SIZE);
+    far_crowd_times.reserve(SPARROW_CROWD_SIZE);
+    near_crowd.reserve(SPARROW_CROWD_SIZE);
+    near_crowd_lods.reserve(SPARROW_CROWD_SIZE);
+    {
+        auto const & bird_mesh = input_model[1].meshes[0];
+        float spacing = 1.5f * std::max(bird_mesh.max.x - bird_mesh.min.x, bird_mesh.max.z - bird_mesh.min.z);
+        int side = std::ceil(std::sqrt(float(SPARROW_CROWD_SIZE)));
+        for (int i = 0; i < SPARROW_CROWD_SIZE; ++i) {
+            crowd_shifts[i] = glm::vec3(i % side - (side - 1) / 2.f, 0.f, i / side - (side - 1) / 2.f) * spacing;
+            crowd_phases[i] = std::fmod(i * 0.618034f, 1.f);
+        }
+    }
+    const glm::vec3 crowd_center{-5.f, 2.f, -15.f};
+    // Bounds of the bird meshes over every frame of both animations, for culling and sizing crowd sparrows on
+    // screen; poses blending the two may reach slightly past them. Computed here rather than on the pool, where
+    // they would wait behind the streaming work.
+    glm::vec3 bird_min(std::numeric_limits<float>::infinity()), bird_max(-std::numeric_limits<float>::infinity());
+    for (float interpolation : {0.f, 1.f}) {
+        float duration = interpolation == 0.f ? idle_a_bird_animation.max_time : spin_bird_animation.max_time;
+        for (float frame_time = 0.f; frame_time <= duration; frame_time += 1.f / ANIMATION_FRAME_RATE) {
+            pose_bird(*bird_animators[0], bird_skeleton_lods[0], frame_time, frame_time, interpolation, 0.f, bones_matrix);
+            for (auto const & mesh : bird_cpu_meshes) {
+                auto const mesh_bounds = posed_bounds(mesh, bones_matrix);
+                bird_min = glm::min(bird_min, mesh_bounds.min);
+                bird_max = glm::max(bird_max, mesh_bounds.max);
+            }
+        }
+    }
+
+    // Idle animation of every bird mesh for the far crowd, positions and normals on texture units 2 and 3
+    struct vertex_animation_textures
+    {
+        vertex_animation frames;
+        GLuint positions;
+        GLuint normals;
+    };
+    std::vector<vertex_animation_textures> bird_vertex_animations;
+    if (SPARROW_CROWD_SIZE > 0) {
+        for (auto const & bird_mesh : input_model[1].meshes) {
+            auto & baked = bird_vertex_animations.emplace_back();
+            baked.frames = bake_vertex_animation(input_model[1], bird_mesh, idle_a_bird_animation, ANIMATION_FRAME_RATE);
+            for (auto [texture, data, format] : {std::tuple{&baked.positions, &baked.frames.positions, GL_RGBA32F},
+                                                 std::tuple{&baked.normals, &baked.frames.normals, GL_RGBA16F}}) {
+                glGenTextures(1, texture);
+                glBindTexture(GL_TEXTURE_2D, *texture);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+                glTexImage2D(GL_TEXTURE_2D, 0, format, baked.frames.width, baked.frames.height, 0, GL_RGBA, GL_FLOAT, data->data());
+            }
+        }
+    }
+
 
     auto vertex_shader_simple = create_shader(GL_VERTEX_SHADER, vertex_shader_source_simple);
     auto fragment_shader_simple = create_shader(GL_FRAGMENT_SHADER, fragment_shader_source_simple);
@@ -479,6 +834,8 @@ int main() try
         float dt = std::chrono::duration_cast<std::chrono::duration<float>>(now - last_frame_start).count();
         last_frame_start = now;
 
+        uploads.run(UPLOAD_BUDGET);
+
         float camera_move_forward = 0.f;
         float camera_move_sideways = 0.f;
 
@@ -535,6 +892,92 @@ int main() try
 
         glm::vec3 light_direction = glm::normalize(glm::vec3(1.f, 2.f, 3.f));
 
+        if (SPARROW_CROWD_SIZE > 0) {
+            near_crowd_shifts.clear();
+            near_crowd.clear();
+            near_crowd_lods.clear();
+            far_crowd_shifts.clear();
+            far_crowd_times.clear();
+            frustum view_frustum(projection * view);
+            float bird_radius = glm::length(bird_max - bird_min) / 2.f;
+            for (int instance = 0; instance < SPARROW_CROWD_SIZE; ++instance) {
+                auto const position = crowd_center + crowd_shifts[instance];
+                float distance = glm::length(position + (bird_min + bird_max) / 2.f - camera_position);
+                if (distance < VERTEX_ANIMATION_DISTANCE && near_crowd.size() < max_near_crowd) {
+                    // Sparrows off screen are neither posed nor drawn, their animations only go on with time
+                    if (!intersect(aabb(position + bird_min, position + bird_max), view_frustum))
+                        continue;
+                    // Fraction of the screen height the bounding sphere spans, the field of view being 90 degrees
+                    float screen_size = bird_radius / distance;
+                    std::size_t lod = 0;
+                    while (lod + 1 < std::size(ANIMATION_LODS) && screen_size < ANIMATION_LODS[lod].screen_size)
+                        ++lod;
+                    near_crowd_shifts.push_back(crowd_shifts[instance]);
+                    near_crowd.push_back(instance);
+                    near_crowd_lods.push_back(lod);
+                } else {
+                    far_crowd_shifts.push_back(crowd_shifts[instance]);
+                    far_crowd_times.push_back(crowd_phases[instance] * idle_a_bird_animation.max_time);
+                }
+            }
+        }
+
+        // The bird and the near crowd are posed on the workers, split in contiguous runs of birds, while this
+        // thread draws the scene up to them
+        {
+            auto const bone_count = input_model[1].bones.size();
+            auto const bird_count = 1 + near_crowd_shifts.size();
+            auto const job_count = std::min(bird_animators.size(), bird_count);
+            for (std::size_t job = 0; job < job_count; ++job) {
+                animation_jobs.push_back(animation_pool.submit([&, job, bone_count, time = time, shift_time = time - start_of_shift,
+                    interpolation = animation_interpolation, first = job * bird_count / job_count,
+                    last = (job + 1) * bird_count / job_count]
+                {
+                    auto & animator = *bird_animators[job];
+                    for (auto bird = first; bird < last; ++bird) {
+                        if (bird == 0) {
+                            pose_bird(animator, bird_skeleton_lods[0], time, shift_time, interpolation, 0.f, bones_matrix);
+                            for (std::size_t i = 0; i < bird_cpu_meshes.size(); ++i)
+                                bird_bounds[i] = posed_bounds(bird_cpu_meshes[i], bones_matrix);
+                            continue;
+                        }
+
+                        auto const instance = near_crowd[bird - 1];
+                        auto const phase = crowd_phases[instance];
+                        auto const lod = near_crowd_lods[bird - 1];
+                        auto const interval = ANIMATION_LODS[lod].update_interval;
+                        auto palette = std::span(crowd_palette).subspan((bird - 1) * bone_count, bone_count);
+                        if (interval <= 0.f) {
+                            pose_bird(animator, bird_skeleton_lods[lod], time, shift_time, interpolation, phase, palette);
+                            continue;
+                        }
+
+                        // The next key is posed once the previous one is reached, both when the sparrow skipped
+                        // past them while off screen or far away
+                        auto & key_times = crowd_key_times[instance];
+                        auto keys = std::span(crowd_key_palettes).subspan(instance * 2 * bone_count, 2 * bone_count);
+                        auto previous = keys.first(bone_count), next = keys.last(bone_count);
+                        if (time < key_times[0] || time >= key_times[1]) {
+                            if (time >= key_times[1] && time < key_times[1] + interval) {
+                                std::copy(next.begin(), next.end(), previous.begin());
+                                key_times[0] = key_times[1];
+                            } else {
+                                pose_bird(animator, bird_skeleton_lods[lod], time, shift_time, interpolation, phase, previous);
+                                key_times[0] = time;
+                            }
+                            key_times[1] = key_times[0] + interval;
+                            pose_bird(animator, bird_skeleton_lods[lod], key_times[1], shift_time + key_times[1] - time,
+                                interpolation, phase, next);
+                        }
+
+                        float t = (time - key_times[0]) / (key_times[1] - key_times[0]);
+                        for (std::size_t i = 0; i < bone_count; ++i)
+                            palette[i] = previous[i] + (next[i] - previous[i]) * t;
+                    }
+                }));
+            }
+        }
+
         //glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
         glClearColor(0.8f, 0.8f, 1.f, 0.f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -563,13 +1006,17 @@ int main() try
         glUniform3fv(light_direction_location, 1, reinterpret_cast<float *>(&light_direction));
         glUniform3fv(camera_position_location, 1, (float *) (&camera_position));
 
+        // All models share the arena vertex arrays, so consecutive meshes usually need no rebind
+        GLuint bound_vao = 0;
         auto draw_meshes = [&](bool transparent, int idx_index,
                                                   glm::mat4 turn_view, bool is_instance = false,
                                                   int dx_minus = 0, int dx_plus = 0,
-                                                  int dz_minus = 0, int dz_plus = 0)
+                                                  int dz_minus = 0, int dz_plus = 0,
+                                                  std::vector<glm::vec3> const * instances = nullptr,
+                                                  std::function<void(std::size_t mesh)> const & prepare_mesh = nullptr)
         {
             glUniform1i(is_instance_location, is_instance);
-            if (is_instance) {
+            if (is_instance && !instances) {
                 glm::vec3 min = input_model[idx_index].meshes[0].min, max = input_model[idx_index].meshes[0].max;
                 aabb(min, max);
                 for (auto & shift : shifts)
@@ -586,10 +1033,13 @@ int main() try
                         auto cur_frustum = frustum(projection * instance_view);
                         if (intersect(cur_aabb, cur_frustum)){
                             float len = glm::length(center - camera_position);
-                            int index = 0;
+                            std::size_t index = 0;
                             while (index < LEVELS_DETAILS - 1 && index + 1 < meshes[idx_index].size() && len > LOD_CONST_LENGTH[index]) {
                                 ++index;
                             }
+                            // Finer LODs that are still streaming in are replaced by the next coarser one
+                            while (index + 1 < meshes[idx_index].size() && !meshes[idx_index][index].range->resident)
+                                ++index;
                             shifts[index].emplace_back(center);
                         }
                     }
@@ -599,8 +1049,10 @@ int main() try
             for (size_t i = 0; i < meshes[idx_index].size(); ++i)
             {
                 auto const &mesh = meshes[idx_index][i];
-                if (mesh.material.transparent != transparent)
+                if (mesh.material.transparent != transparent || !mesh.range->resident)
                     continue;
+                auto const * range = !is_instance && mesh.skinned_range && mesh.skinned_range->resident
+                        ? mesh.skinned_range : mesh.range;
 
                 if (mesh.material.two_sided)
                     glDisable(GL_CULL_FACE);
@@ -626,20 +1078,28 @@ int main() try
 
                 glUniform1f(roughness_location, mesh.material.roughnessFactor);
 
+                if (range->vao != bound_vao) {
+                    glBindVertexArray(range->vao);
+                    bound_vao = range->vao;
+                }
+                glDisableVertexAttribArray(6);
+                if (prepare_mesh)
+                    prepare_mesh(i);
                 if (!is_instance) {
-                    glBindVertexArray(mesh.vao);
-                    glDrawElements(GL_TRIANGLES, mesh.indices.count, mesh.indices.type,
-                                   reinterpret_cast<void *>(mesh.indices.view.offset));
+                    glDisableVertexAttribArray(5);
+                    glDrawElementsBaseVertex(GL_TRIANGLES, range->index_count, range->index_type,
+                                             reinterpret_cast<void *>(range->index_offset), range->base_vertex);
                 } else {
-                    auto &shift = shifts[i];
-                    glBindVertexArray(mesh.vao);
+                    auto const &shift = instances ? *instances : shifts[i];
                     glBindBuffer(GL_ARRAY_BUFFER, vbo_shifts);
                     glBufferData(GL_ARRAY_BUFFER, shift.size() * sizeof(shift[0]), shift.data(), GL_STATIC_DRAW);
+                    glEnableVertexAttribArray(5);
                     glVertexAttribPointer(5, 3, GL_FLOAT, GL_FALSE, 0, reinterpret_cast<void *>(0));
                     glVertexAttribDivisor(5, 1);
                     glUniformMatrix4fv(instance_turn_location, 1, GL_FALSE, reinterpret_cast<float *>(&turn_view));
-                    glDrawElementsInstanced(GL_TRIANGLES, mesh.indices.count, mesh.indices.type,
-                                            reinterpret_cast<void *>(mesh.indices.view.offset), shift.size());
+                    glDrawElementsInstancedBaseVertex(GL_TRIANGLES, range->index_count, range->index_type,
+                                                      reinterpret_cast<void *>(range->index_offset), shift.size(),
+                                                      range->base_vertex);
                 }
             }
 
@@ -661,55 +1121,99 @@ int main() try
 
         glUniformMatrix4fv(view_location, 1, GL_FALSE, reinterpret_cast<float *>(&bird_view));
 
-        std::vector<glm::mat4x3> bones_matrix(input_model[1].bones.size(), glm::mat4x3(1));
-        std::vector<glm::mat4> transforms(idle_a_bird_animation.bones.size());
+        for (auto & job : animation_jobs)
+            job.get();
+        animation_jobs.clear();
+
+        bone_palettes.begin_frame();
+        bone_palettes.bind(GL_TEXTURE1);
+        glUniform1i(bone_palette_location, 1);
+        auto const palette_offset = bone_palettes.write(bones_matrix);
+        glUniform1i(palette_offset_location, palette_offset);
+        glUniform1i(palette_bone_count_location, bones_matrix.size());
+        glUniform1i(dual_quaternion_skinning_location, SKINNING_MODE == skinning_mode::dual_quaternion);
+
+        // The bird is neither skinned nor drawn when its posed bounds are out of view
+        glm::vec3 bird_posed_min(std::numeric_limits<float>::infinity()), bird_posed_max(-std::numeric_limits<float>::infinity());
+        for (auto const & mesh_bounds : bird_bounds) {
+            bird_posed_min = glm::min(bird_posed_min, mesh_bounds.min);
+            bird_posed_max = glm::max(bird_posed_max, mesh_bounds.max);
+        }
+        bool const bird_visible = intersect(aabb(bird_posed_min, bird_posed_max), frustum(projection * bird_view));
+
+        if (SKIN_ONCE && bird_visible) {
+            glUseProgram(skinning_program);
+            glUniform1i(skinning_bone_palette_location, 1);
+            glUniform1i(skinning_palette_offset_location, palette_offset);
+            glUniform1i(skinning_palette_bone_count_location, bones_matrix.size());
+            glUniform1i(skinning_dual_quaternion_skinning_location, SKINNING_MODE == skinning_mode::dual_quaternion);
+            bird_skinned.skin();
+            bound_vao = 0;
+            glUseProgram(program);
+        }
 
-        for (size_t i = 0; i < spin_bird_animation.bones.size(); ++i) {
-            const auto& cur_bone = spin_bird_animation.bones[i];
-            auto spin_animation_time = std::fmod(time - start_of_shift, spin_bird_animation.max_time);
-            auto spin_translation = get_or_default_translation(cur_bone.translation, spin_animation_time);
-            auto spin_rotation = get_or_default_rotation(cur_bone.rotation, spin_animation_time);
-            auto spin_scale = get_or_default_scale(cur_bone.scale, spin_animation_time);
+        // The transform feedback output is already skinned
+        glUniform1i(is_rigged_location, !SKIN_ONCE);
+        if (bird_visible) {
+            draw_meshes(false, 1, bird_view);
+            glDepthMask(GL_FALSE);
+            draw_meshes(true, 1, bird_view);
+            glDepthMask(GL_TRUE);
+        }
 
-            if (i == 0) {
-                spin_translation += glm::vec3(0, -0.5, 0);
-                spin_rotation = glm::rotate(spin_rotation, -glm::pi<float>() / 2, {1.f, 0.f, 0.f});
+        if (SPARROW_CROWD_SIZE > 0) {
+            glm::mat4 crowd_view = glm::translate(view, crowd_center);
+            glUniformMatrix4fv(view_location, 1, GL_FALSE, reinterpret_cast<float *>(&crowd_view));
+
+            if (!near_crowd_shifts.empty()) {
+                auto const bone_count = input_model[1].bones.size();
+                auto offset = bone_palettes.write(std::span(crowd_palette).first(near_crowd_shifts.size() * bone_count));
+                glUniform1i(palette_offset_location, offset);
+
+                // The crowd draws the arena ranges, skinned in the vertex shader
+                glUniform1i(is_rigged_location, 1);
+                draw_meshes(false, 1, glm::mat4(1), true, 0, 0, 0, 0, &near_crowd_shifts);
+                glDepthMask(GL_FALSE);
+                draw_meshes(true, 1, glm::mat4(1), true, 0, 0, 0, 0, &near_crowd_shifts);
+                glDepthMask(GL_TRUE);
             }
-            const auto& idle_bone = idle_a_bird_animation.bones[i];
-            auto idle_animation_time = std::fmod(time, idle_a_bird_animation.max_time);
-            auto idle_translation = get_or_default_translation(idle_bone.translation, idle_animation_time);
-            auto idle_rotation = get_or_default_rotation(idle_bone.rotation, idle_animation_time);
-            auto idle_scale = get_or_default_scale(idle_bone.scale, idle_animation_time);
-
-            auto translation = glm::lerp(idle_translation, spin_translation, animation_interpolation);
-            auto rotation = glm::slerp(idle_rotation, spin_rotation, animation_interpolation);
-            auto scale = glm::lerp(idle_scale, spin_scale, animation_interpolation);
 
-            auto glm_translate = glm::translate(glm::mat4(1.f), translation);
-            auto glm_rotation = glm::toMat4(rotation);
-            auto glm_scale = glm::scale(glm::mat4(1.f), scale);
+            if (!far_crowd_shifts.empty()) {
+                glBindBuffer(GL_ARRAY_BUFFER, vbo_instance_times);
+                glBufferData(GL_ARRAY_BUFFER, far_crowd_times.size() * sizeof(far_crowd_times[0]), far_crowd_times.data(), GL_STREAM_DRAW);
+                glUniform1i(use_vertex_animation_location, 1);
+                glUniform1f(time_location, time);
+                glUniform1i(vertex_animation_positions_location, 2);
+                glUniform1i(vertex_animation_normals_location, 3);
 
+                auto prepare_vertex_animation = [&](std::size_t mesh)
+                {
+                    auto const & baked = bird_vertex_animations[mesh];
+                    glActiveTexture(GL_TEXTURE2);
+                    glBindTexture(GL_TEXTURE_2D, baked.positions);
+                    glActiveTexture(GL_TEXTURE3);
+                    glBindTexture(GL_TEXTURE_2D, baked.normals);
+                    glActiveTexture(GL_TEXTURE0);
+                    glUniform1i(vertex_animation_vertex_count_location, baked.frames.vertex_count);
+                    glUniform1i(vertex_animation_frame_count_location, baked.frames.frame_count);
+                    glUniform1f(vertex_animation_frame_rate_location, baked.frames.frame_rate);
+                    glUniform1f(vertex_animation_duration_location, baked.frames.duration);
+                    glUniform1i(vertex_animation_base_vertex_location, meshes[1][mesh].range->base_vertex);
+
+                    glBindBuffer(GL_ARRAY_BUFFER, vbo_instance_times);
+                    glEnableVertexAttribArray(6);
+                    glVertexAttribPointer(6, 1, GL_FLOAT, GL_FALSE, 0, reinterpret_cast<void *>(0));
+                    glVertexAttribDivisor(6, 1);
+                };
 
-            transforms[i] = glm_translate * glm_rotation * glm_scale; //glm_translate * glm_rotation * glm_scale
-            auto parent = input_model[1].bones[i].parent;
-            if (parent != -1) {
-                transforms[i] = transforms[parent] * transforms[i];
+                draw_meshes(false, 1, glm::mat4(1), true, 0, 0, 0, 0, &far_crowd_shifts, prepare_vertex_animation);
+                glDepthMask(GL_FALSE);
+                draw_meshes(true, 1, glm::mat4(1), true, 0, 0, 0, 0, &far_crowd_shifts, prepare_vertex_animation);
+                glDepthMask(GL_TRUE);
+                glUniform1i(use_vertex_animation_location, 0);
             }
-
-            bones_matrix[i] = transforms[i];
-        }
-        for (size_t i = 0; i < input_model[1].bones.size(); ++i) {
-            bones_matrix[i] = bones_matrix[i] * input_model[1].bones[i].inverse_bind_matrix;
         }
 
-        glUniformMatrix4x3fv(bones_location, bones_matrix.size(), GL_FALSE, reinterpret_cast<float *>(bones_matrix.data()));
-
-        glUniform1i(is_rigged_location, 1);
-        draw_meshes(false, 1, bird_view);
-        glDepthMask(GL_FALSE);
-        draw_meshes(true, 1, bird_view);
-        glDepthMask(GL_TRUE);
-
         glm::mat4 disco_view = glm::translate(view, glm::vec3(0.,  15., 0.));
         disco_view = glm::rotate(disco_view, -glm::pi<float>() / 2, {1.f, 0.f, 0.f});
         disco_view = glm::rotate(disco_view, padoru_turning_angle, {0.f, 0.f, 1.f});
@@ -774,6 +1278,7 @@ int main() try
         glBindVertexArray(vao_text);
         glDrawArrays(GL_TRIANGLES, 0, number_of_trim_texts);
 
+        bone_palettes.end_frame();
         SDL_GL_SwapWindow(window);
     }
 
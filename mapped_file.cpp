@@ -0,0 +1,75 @@
+#include "mapped_file.hpp"
+
+#include <stdexcept>
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#ifdef WIN32
+
+mapped_file::mapped_file(std::filesystem::path const & path)
+{
+    file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        throw std::runtime_error("Failed to open " + path.string());
+
+    LARGE_INTEGER file_size;
+    GetFileSizeEx(file, &file_size);
+    size = file_size.QuadPart;
+    if (size == 0)
+        return;
+
+    mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping)
+        address = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!address) {
+        if (mapping) CloseHandle(mapping);
+        CloseHandle(file);
+        throw std::runtime_error("Failed to map " + path.string());
+    }
+}
+
+mapped_file::~mapped_file()
+{
+    if (address) UnmapViewOfFile(address);
+    if (mapping) CloseHandle(mapping);
+    CloseHandle(file);
+}
+
+#else
+
+mapped_file::mapped_file(std::filesystem::path const & path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("Failed to open " + path.string());
+
+    size = std::filesystem::file_size(path);
+    if (size == 0) {
+        close(fd);
+        return;
+    }
+
+    address = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping keeps its own reference to the file
+    close(fd);
+    if (address == MAP_FAILED) {
+        address = nullptr;
+        throw std::runtime_error("Failed to map " + path.string());
+    }
+
+    // Everything gets read right away by the parser and the GL upload
+    madvise(address, size, MADV_WILLNEED);
+}
+
+mapped_file::~mapped_file()
+{
+    if (address) munmap(address, size);
+}
+
+#endif
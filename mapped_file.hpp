@@ -0,0 +1,27 @@
+#pragma once
+
+#include <filesystem>
+#include <span>
+
+// Read-only mapping of a whole file into memory, unmapped on destruction
+struct mapped_file
+{
+    explicit mapped_file(std::filesystem::path const & path);
+    ~mapped_file();
+
+    mapped_file(mapped_file const &) = delete;
+    mapped_file & operator = (mapped_file const &) = delete;
+
+    std::span<char const> data() const
+    {
+        return {static_cast<char const *>(address), size};
+    }
+
+private:
+    void * address = nullptr;
+    std::size_t size = 0;
+#ifdef WIN32
+    void * file = nullptr;
+    void * mapping = nullptr;
+#endif
+};
@@ -0,0 +1,400 @@
+#include "meshopt_decoder.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+
+using byte = unsigned char;
+
+constexpr byte vertex_header = 0xa0;
+constexpr byte index_header = 0xe0;
+constexpr byte sequence_header = 0xd0;
+
+constexpr std::size_t byte_group_size = 16;
+constexpr std::size_t vertex_block_size_bytes = 8192;
+constexpr std::size_t vertex_block_max_size = 256;
+constexpr std::size_t vertex_tail_max_size = 32;
+constexpr std::size_t max_vertex_size = 256;
+
+[[noreturn]] void malformed()
+{
+    throw std::runtime_error("Malformed EXT_meshopt_compression data");
+}
+
+// Byte stream with bounds checks against the end of the encoded data
+struct reader
+{
+    byte const * data;
+    byte const * end;
+
+    std::size_t left() const
+    {
+        return end - data;
+    }
+
+    byte next()
+    {
+        if (data == end)
+            malformed();
+        return *data++;
+    }
+
+    // LEB128-style variable length integer, at most 5 bytes
+    std::uint32_t vbyte()
+    {
+        byte const lead = next();
+        if (lead < 128)
+            return lead;
+
+        std::uint32_t result = lead & 127;
+        unsigned int shift = 7;
+        for (int i = 0; i < 4; ++i) {
+            byte const group = next();
+            result |= std::uint32_t(group & 127) << shift;
+            shift += 7;
+            if (group < 128)
+                break;
+        }
+        return result;
+    }
+};
+
+byte unzigzag8(byte v)
+{
+    return byte(-(v & 1) ^ (v >> 1));
+}
+
+std::uint32_t unzigzag32(std::uint32_t v)
+{
+    return (v >> 1) ^ -(v & 1);
+}
+
+// One group of 16 bytes, each stored in 0, 2, 4 or 8 bits; 2 and 4 bit values equal to all ones escape to a full byte
+void decode_bytes_group(reader & input, byte * destination, int bits_log2)
+{
+    if (bits_log2 == 0) {
+        std::memset(destination, 0, byte_group_size);
+        return;
+    }
+    if (bits_log2 == 3) {
+        if (input.left() < byte_group_size)
+            malformed();
+        std::memcpy(destination, input.data, byte_group_size);
+        input.data += byte_group_size;
+        return;
+    }
+
+    unsigned int const bits = bits_log2 == 1 ? 2 : 4;
+    unsigned int const sentinel = (1u << bits) - 1;
+    auto const packed_size = byte_group_size * bits / 8;
+    if (input.left() < packed_size)
+        malformed();
+
+    reader escapes{input.data + packed_size, input.end};
+    for (std::size_t i = 0; i < byte_group_size; ++i) {
+        unsigned int const shift = 8 - bits - (i * bits) % 8;
+        unsigned int const value = (input.data[i * bits / 8] >> shift) & sentinel;
+        destination[i] = value == sentinel ? escapes.next() : byte(value);
+    }
+    input.data = escapes.data;
+}
+
+void decode_bytes(reader & input, byte * destination, std::size_t size)
+{
+    auto const group_count = size / byte_group_size;
+    auto const header_size = (group_count + 3) / 4;
+    if (input.left() < header_size)
+        malformed();
+    byte const * header = input.data;
+    input.data += header_size;
+
+    for (std::size_t g = 0; g < group_count; ++g) {
+        int const bits_log2 = (header[g / 4] >> ((g % 4) * 2)) & 3;
+        decode_bytes_group(input, destination + g * byte_group_size, bits_log2);
+    }
+}
+
+// Bytes of each vertex are stored transposed, as per-byte delta streams from the previous vertex
+void decode_vertex_block(reader & input, byte * destination, std::size_t count, std::size_t stride, byte * last_vertex)
+{
+    byte deltas[vertex_block_max_size];
+    auto const count_aligned = (count + byte_group_size - 1) & ~(byte_group_size - 1);
+
+    for (std::size_t k = 0; k < stride; ++k) {
+        decode_bytes(input, deltas, count_aligned);
+
+        byte previous = last_vertex[k];
+        for (std::size_t i = 0; i < count; ++i) {
+            previous = byte(unzigzag8(deltas[i]) + previous);
+            destination[i * stride + k] = previous;
+        }
+        last_vertex[k] = previous;
+    }
+}
+
+void write_index(char * destination, std::size_t index_size, std::size_t i, std::uint32_t value)
+{
+    if (index_size == 2) {
+        auto const narrow = static_cast<std::uint16_t>(value);
+        std::memcpy(destination + i * 2, &narrow, 2);
+    } else {
+        std::memcpy(destination + i * 4, &value, 4);
+    }
+}
+
+void check_output(std::span<char> destination, std::size_t count, std::size_t element_size)
+{
+    if (destination.size() < count * element_size)
+        throw std::runtime_error("EXT_meshopt_compression output does not fit its bufferView");
+}
+
+template <typename T>
+T round_to(float value)
+{
+    return T(int(value + (value >= 0.f ? 0.5f : -0.5f)));
+}
+
+template <typename T>
+void decode_octahedral(char * data, std::size_t count, std::size_t stride)
+{
+    float const max = float((1 << (sizeof(T) * 8 - 1)) - 1);
+    for (std::size_t i = 0; i < count; ++i) {
+        T v[4];
+        std::memcpy(v, data + i * stride, sizeof(v));
+
+        float x = v[0], y = v[1];
+        float const z = float(v[2]) - std::fabs(x) - std::fabs(y);
+        // Unfold the lower hemisphere
+        float const t = z >= 0.f ? 0.f : z;
+        x += x >= 0.f ? t : -t;
+        y += y >= 0.f ? t : -t;
+
+        float const scale = max / std::sqrt(x * x + y * y + z * z);
+        v[0] = round_to<T>(x * scale);
+        v[1] = round_to<T>(y * scale);
+        v[2] = round_to<T>(z * scale);
+        std::memcpy(data + i * stride, v, sizeof(v));
+    }
+}
+
+// Three smallest components plus the index of the largest one, which is reconstructed
+void decode_quaternion(char * data, std::size_t count, std::size_t stride)
+{
+    float const scale = 1.f / std::sqrt(2.f);
+    for (std::size_t i = 0; i < count; ++i) {
+        std::int16_t v[4];
+        std::memcpy(v, data + i * stride, sizeof(v));
+
+        float const range = scale / float(v[3] | 3);
+        float const x = v[0] * range, y = v[1] * range, z = v[2] * range;
+        float const ww = 1.f - x * x - y * y - z * z;
+        float const w = std::sqrt(ww >= 0.f ? ww : 0.f);
+
+        int const largest = v[3] & 3;
+        std::int16_t result[4];
+        result[(largest + 1) & 3] = round_to<std::int16_t>(x * 32767.f);
+        result[(largest + 2) & 3] = round_to<std::int16_t>(y * 32767.f);
+        result[(largest + 3) & 3] = round_to<std::int16_t>(z * 32767.f);
+        result[largest] = round_to<std::int16_t>(w * 32767.f);
+        std::memcpy(data + i * stride, result, sizeof(result));
+    }
+}
+
+// 24-bit mantissa and 8-bit exponent per component
+void decode_exponential(char * data, std::size_t count, std::size_t stride)
+{
+    for (std::size_t i = 0; i < count * stride / 4; ++i) {
+        std::int32_t v;
+        std::memcpy(&v, data + i * 4, 4);
+
+        std::int32_t const mantissa = std::int32_t(std::uint32_t(v) << 8) >> 8;
+        std::int32_t const exponent = v >> 24;
+        float const result = std::ldexp(float(mantissa), exponent);
+        std::memcpy(data + i * 4, &result, 4);
+    }
+}
+
+}
+
+void decode_meshopt_vertices(std::span<char> destination, std::size_t count, std::size_t stride, std::span<char const> source)
+{
+    if (stride == 0 || stride > max_vertex_size || stride % 4 != 0)
+        malformed();
+    check_output(destination, count, stride);
+
+    reader input{reinterpret_cast<byte const *>(source.data()), reinterpret_cast<byte const *>(source.data() + source.size())};
+    if (input.next() != vertex_header)
+        throw std::runtime_error("Unsupported EXT_meshopt_compression vertex codec version");
+
+    // The tail holds the first vertex, which every delta stream starts from
+    auto const tail_size = std::max(stride, vertex_tail_max_size);
+    if (input.left() < tail_size)
+        malformed();
+    byte last_vertex[max_vertex_size];
+    std::memcpy(last_vertex, input.end - stride, stride);
+    input.end -= tail_size;
+
+    auto const block_size = std::min((vertex_block_size_bytes / stride) & ~(byte_group_size - 1), vertex_block_max_size);
+    auto output = reinterpret_cast<byte *>(destination.data());
+    for (std::size_t offset = 0; offset < count; offset += block_size)
+        decode_vertex_block(input, output + offset * stride, std::min(block_size, count - offset), stride, last_vertex);
+
+    if (input.left() != 0)
+        malformed();
+}
+
+void decode_meshopt_triangles(std::span<char> destination, std::size_t count, std::size_t index_size, std::span<char const> source)
+{
+    if (count % 3 != 0 || (index_size != 2 && index_size != 4))
+        malformed();
+    check_output(destination, count, index_size);
+
+    // Header, one code per triangle, variable length data and a 16 byte table of common auxiliary codes
+    if (source.size() < 1 + count / 3 + 16)
+        malformed();
+    auto const begin = reinterpret_cast<byte const *>(source.data());
+    int const version = begin[0] & 0x0f;
+    if ((begin[0] & 0xf0) != index_header || version > 1)
+        throw std::runtime_error("Unsupported EXT_meshopt_compression index codec version");
+
+    byte const * codes = begin + 1;
+    byte const * aux_table = begin + source.size() - 16;
+    reader data{codes + count / 3, aux_table};
+
+    // Recently seen edges and vertices, 16 each, addressed backwards from the write position
+    std::uint32_t edges[16][2];
+    std::uint32_t vertices[16];
+    std::memset(edges, -1, sizeof(edges));
+    std::memset(vertices, -1, sizeof(vertices));
+    unsigned int edge_offset = 0, vertex_offset = 0;
+    std::uint32_t next = 0, last = 0;
+    int const max_fifo_code = version >= 1 ? 13 : 15;
+
+    auto push_vertex = [&](std::uint32_t v, bool advance = true)
+    {
+        vertices[vertex_offset] = v;
+        vertex_offset = (vertex_offset + advance) & 15;
+    };
+    auto push_edge = [&](std::uint32_t a, std::uint32_t b)
+    {
+        edges[edge_offset][0] = a;
+        edges[edge_offset][1] = b;
+        edge_offset = (edge_offset + 1) & 15;
+    };
+    auto decode_index = [&]
+    {
+        last += unzigzag32(data.vbyte());
+        return last;
+    };
+
+    for (std::size_t i = 0; i < count; i += 3) {
+        byte const code = *codes++;
+        std::uint32_t a, b, c;
+
+        if (code < 0xf0) {
+            // Triangle sharing an edge with a recent one
+            auto const & edge = edges[(edge_offset - 1 - (code >> 4)) & 15];
+            a = edge[0];
+            b = edge[1];
+            int const fec = code & 15;
+            if (fec < max_fifo_code) {
+                c = fec == 0 ? next++ : vertices[(vertex_offset - 1 - fec) & 15];
+                push_vertex(c, fec == 0);
+            } else {
+                // Version 1 encodes 13 and 14 as the last free index -1 and +1
+                last = c = fec != 15 ? last + (fec - (fec ^ 3)) : decode_index();
+                push_vertex(c);
+            }
+            push_edge(c, b);
+            push_edge(a, c);
+        } else {
+            byte const aux = code < 0xfe ? aux_table[code & 15] : data.next();
+            int const fea = code == 0xff ? 15 : 0;
+            int const feb = aux >> 4;
+            int const fec = aux & 15;
+            if (code >= 0xfe && aux == 0)
+                next = 0;
+
+            // All new vertices take their numbers before any free index is decoded
+            a = fea == 0 ? next++ : 0;
+            b = feb == 0 ? next++ : vertices[(vertex_offset - feb) & 15];
+            c = fec == 0 ? next++ : vertices[(vertex_offset - fec) & 15];
+            if (fea == 15) last = a = decode_index();
+            if (feb == 15) last = b = decode_index();
+            if (fec == 15) last = c = decode_index();
+
+            push_vertex(a);
+            push_vertex(b, feb == 0 || feb == 15);
+            push_vertex(c, fec == 0 || fec == 15);
+            push_edge(b, a);
+            push_edge(c, b);
+            push_edge(a, c);
+        }
+
+        write_index(destination.data(), index_size, i + 0, a);
+        write_index(destination.data(), index_size, i + 1, b);
+        write_index(destination.data(), index_size, i + 2, c);
+    }
+
+    if (data.left() != 0)
+        malformed();
+}
+
+void decode_meshopt_indices(std::span<char> destination, std::size_t count, std::size_t index_size, std::span<char const> source)
+{
+    if (index_size != 2 && index_size != 4)
+        malformed();
+    check_output(destination, count, index_size);
+
+    if (source.size() < 1 + count + 4)
+        malformed();
+    auto const begin = reinterpret_cast<byte const *>(source.data());
+    if ((begin[0] & 0xf0) != sequence_header || (begin[0] & 0x0f) > 1)
+        throw std::runtime_error("Unsupported EXT_meshopt_compression index sequence version");
+
+    reader data{begin + 1, begin + source.size() - 4};
+
+    // Deltas alternate between two baselines, selected by the lowest bit
+    std::uint32_t last[2] = {0, 0};
+    for (std::size_t i = 0; i < count; ++i) {
+        std::uint32_t const v = data.vbyte();
+        auto & baseline = last[v & 1];
+        baseline += unzigzag32(v >> 1);
+        write_index(destination.data(), index_size, i, baseline);
+    }
+
+    if (data.left() != 0)
+        malformed();
+}
+
+void apply_meshopt_filter(meshopt_filter filter, std::span<char> data, std::size_t count, std::size_t stride)
+{
+    check_output(data, count, stride);
+
+    switch (filter) {
+    case meshopt_filter::none:
+        break;
+    case meshopt_filter::octahedral:
+        if (stride == 4)
+            decode_octahedral<std::int8_t>(data.data(), count, stride);
+        else if (stride == 8)
+            decode_octahedral<std::int16_t>(data.data(), count, stride);
+        else
+            malformed();
+        break;
+    case meshopt_filter::quaternion:
+        if (stride != 8)
+            malformed();
+        decode_quaternion(data.data(), count, stride);
+        break;
+    case meshopt_filter::exponential:
+        if (stride % 4 != 0)
+            malformed();
+        decode_exponential(data.data(), count, stride);
+        break;
+    }
+}
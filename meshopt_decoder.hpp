@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+
+// Decoders of the EXT_meshopt_compression bufferView bitstreams (the meshoptimizer vertex and index codecs).
+// All of them throw std::runtime_error on malformed input and never read outside `source`.
+
+enum class meshopt_filter
+{
+    none,
+    octahedral,
+    quaternion,
+    exponential,
+};
+
+// ATTRIBUTES mode: `count` elements of `stride` bytes
+void decode_meshopt_vertices(std::span<char> destination, std::size_t count, std::size_t stride, std::span<char const> source);
+
+// TRIANGLES mode: `count` indices of `index_size` (2 or 4) bytes
+void decode_meshopt_triangles(std::span<char> destination, std::size_t count, std::size_t index_size, std::span<char const> source);
+
+// INDICES mode: `count` indices of `index_size` (2 or 4) bytes
+void decode_meshopt_indices(std::span<char> destination, std::size_t count, std::size_t index_size, std::span<char const> source);
+
+// Undoes a filter in place on decoded ATTRIBUTES data
+void apply_meshopt_filter(meshopt_filter filter, std::span<char> data, std::size_t count, std::size_t stride);
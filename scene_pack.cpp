@@ -0,0 +1,553 @@
+#include "scene_pack.hpp"
+#include "mapped_file.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <cstring>
+#include <type_traits>
+
+// Bump whenever the layout below or any serialized gltf_model struct changes
+static constexpr std::uint32_t pack_version = 3;
+static constexpr char pack_magic[8] = {'S', 'C', 'N', 'P', 'A', 'C', 'K', '\0'};
+static constexpr std::size_t pack_alignment = 16;
+
+// The file is the header, the metadata stream and the blob section; blobs (buffers, pixels)
+// are referenced by offsets relative to the blob section, so the pack is relocatable; keyframes point into buffer blobs
+struct pack_header
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t reserved;
+    std::uint64_t source_hash;
+    std::uint64_t metadata_size;
+    std::uint64_t blob_offset;
+};
+
+struct pack_blob
+{
+    std::uint64_t offset;
+    std::uint64_t size;
+};
+
+struct pack_keys
+{
+    static constexpr std::uint32_t none = -1;
+
+    std::uint32_t buffer;
+    std::uint32_t count;
+    std::uint64_t offset;
+};
+
+static std::size_t align_up(std::size_t value)
+{
+    return (value + pack_alignment - 1) / pack_alignment * pack_alignment;
+}
+
+static std::uint64_t fnv1a(std::span<char const> data, std::uint64_t hash = 0xcbf29ce484222325ull)
+{
+    for (char c : data) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+// Hash of the source document contents combined with the size and modification time of every
+// other file next to it (external buffers, textures), so touching any of them invalidates the pack
+static std::uint64_t source_hash(std::filesystem::path const & source_path)
+{
+    std::uint64_t hash = fnv1a(mapped_file(source_path).data());
+
+    auto const directory = source_path.parent_path();
+    for (auto const & entry : std::filesystem::recursive_directory_iterator(directory)) {
+        auto const extension = entry.path().extension();
+        if (!entry.is_regular_file() || entry.path() == source_path || extension == ".pack" || extension == ".tmp")
+            continue;
+
+        auto const name = entry.path().lexically_relative(directory).generic_string();
+        std::uint64_t const stamp[] = {
+                entry.file_size(),
+                static_cast<std::uint64_t>(entry.last_write_time().time_since_epoch().count()),
+        };
+        hash = fnv1a(name, hash);
+        hash = fnv1a({reinterpret_cast<char const *>(stamp), sizeof(stamp)}, hash);
+    }
+
+    return hash;
+}
+
+struct pack_writer
+{
+    std::vector<char> metadata;
+    std::vector<char> blobs;
+
+    template <typename T>
+    void write(T const & value)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        auto bytes = reinterpret_cast<char const *>(&value);
+        metadata.insert(metadata.end(), bytes, bytes + sizeof(T));
+    }
+
+    void write_string(std::string const & value)
+    {
+        write(static_cast<std::uint32_t>(value.size()));
+        metadata.insert(metadata.end(), value.begin(), value.end());
+    }
+
+    void write_blob(std::span<char const> data)
+    {
+        blobs.resize(align_up(blobs.size()));
+        write(pack_blob{blobs.size(), data.size()});
+        blobs.insert(blobs.end(), data.begin(), data.end());
+    }
+
+    // Keyframes always lie in one of the model buffers, which the pack stores anyway, so only their location is written
+    template <typename T>
+    void write_keys(gltf_model const & model, std::span<T const> keys)
+    {
+        pack_keys result{pack_keys::none, static_cast<std::uint32_t>(keys.size()), 0};
+        auto const bytes = reinterpret_cast<char const *>(keys.data());
+        for (std::uint32_t b = 0; b < model.buffers.size() && !keys.empty(); ++b) {
+            auto const & buffer = model.buffers[b];
+            if (bytes >= buffer.data() && bytes + keys.size_bytes() <= buffer.data() + buffer.size()) {
+                result.buffer = b;
+                result.offset = bytes - buffer.data();
+                break;
+            }
+        }
+        if (!keys.empty() && result.buffer == pack_keys::none)
+            throw std::runtime_error("Keyframes outside of the model buffers");
+        write(result);
+    }
+};
+
+struct pack_reader
+{
+    std::span<char const> metadata;
+    std::span<char const> blobs;
+    std::size_t position = 0;
+
+    template <typename T>
+    T read()
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        if (position + sizeof(T) > metadata.size())
+            throw std::runtime_error("Truncated scene pack");
+        T result;
+        std::memcpy(&result, metadata.data() + position, sizeof(T));
+        position += sizeof(T);
+        return result;
+    }
+
+    std::string read_string()
+    {
+        auto const size = read<std::uint32_t>();
+        if (position + size > metadata.size())
+            throw std::runtime_error("Truncated scene pack");
+        std::string result(metadata.data() + position, size);
+        position += size;
+        return result;
+    }
+
+    std::span<char const> read_blob()
+    {
+        auto const blob = read<pack_blob>();
+        if (blob.offset + blob.size > blobs.size())
+            throw std::runtime_error("Scene pack blob out of range");
+        return blobs.subspan(blob.offset, blob.size);
+    }
+
+    template <typename T>
+    void read_keys(gltf_model const & model, std::span<T const> & keys)
+    {
+        auto const location = read<pack_keys>();
+        if (location.buffer == pack_keys::none) {
+            keys = {};
+            return;
+        }
+        if (location.buffer >= model.buffers.size() || location.offset + std::uint64_t(location.count) * sizeof(T) > model.buffers[location.buffer].size())
+            throw std::runtime_error("Scene pack keyframes out of range");
+        keys = {reinterpret_cast<T const *>(model.buffers[location.buffer].data() + location.offset), location.count};
+    }
+};
+
+// First material using each texture of the model
+static std::vector<gltf_model::material const *> texture_materials(gltf_model const & model)
+{
+    std::vector<gltf_model::material const *> result;
+    for (auto const & mesh : model.meshes) {
+        auto const & material = mesh.material;
+        if (!material.texture_path)
+            continue;
+        auto same_texture = [&](auto const * other){ return other->texture_path == material.texture_path; };
+        if (std::none_of(result.begin(), result.end(), same_texture))
+            result.push_back(&material);
+    }
+    return result;
+}
+
+static texture_data bake_texture(gltf_model const & model, std::filesystem::path const & source_path, gltf_model::material const & material)
+{
+    auto texture = load_texture_data(model, source_path, material);
+    generate_mipmaps(texture);
+    return texture;
+}
+
+baked_scene bake_scene(std::filesystem::path const & source_path)
+{
+    baked_scene result{load_gltf(source_path)};
+
+    for (auto const * material : texture_materials(result.model))
+        result.textures[*material->texture_path] = bake_texture(result.model, source_path, *material);
+
+    return result;
+}
+
+void save_scene_pack(baked_scene const & scene, std::filesystem::path const & source_path, std::filesystem::path const & pack_path)
+{
+    auto const & model = scene.model;
+    pack_writer writer;
+
+    writer.write(static_cast<std::uint32_t>(model.buffers.size()));
+    for (auto const & buffer : model.buffers)
+        writer.write_blob(buffer);
+
+    writer.write(static_cast<std::uint32_t>(model.meshes.size()));
+    for (auto const & mesh : model.meshes) {
+        writer.write_string(mesh.name);
+
+        auto const & material = mesh.material;
+        writer.write(material.two_sided);
+        writer.write(material.transparent);
+        writer.write(material.texture_path.has_value());
+        if (material.texture_path)
+            writer.write_string(*material.texture_path);
+        writer.write(material.texture_view.has_value());
+        if (material.texture_view)
+            writer.write(*material.texture_view);
+        writer.write(material.color.has_value());
+        if (material.color)
+            writer.write(*material.color);
+        writer.write(material.metallicFactor);
+        writer.write(material.roughnessFactor);
+
+        writer.write(mesh.indices);
+        writer.write(mesh.position);
+        writer.write(mesh.normal);
+        writer.write(mesh.texcoord);
+        writer.write(mesh.min);
+        writer.write(mesh.max);
+        writer.write(mesh.is_rigged);
+        writer.write(mesh.joints);
+        writer.write(mesh.weights);
+    }
+
+    writer.write(static_cast<std::uint32_t>(model.bones.size()));
+    for (auto const & bone : model.bones) {
+        writer.write(bone.parent);
+        writer.write_string(bone.name);
+        writer.write(bone.inverse_bind_matrix);
+    }
+
+    writer.write(static_cast<std::uint32_t>(model.animations.size()));
+    for (auto const & [name, animation] : model.animations) {
+        writer.write_string(name);
+        writer.write(animation.max_time);
+        writer.write(static_cast<std::uint32_t>(animation.bones.size()));
+        for (auto const & bone : animation.bones) {
+            writer.write_keys(model, bone.translation.timestamps);
+            writer.write_keys(model, bone.translation.values);
+            writer.write_keys(model, bone.rotation.timestamps);
+            writer.write_keys(model, bone.rotation.values);
+            writer.write_keys(model, bone.scale.timestamps);
+            writer.write_keys(model, bone.scale.values);
+        }
+    }
+
+    writer.write(static_cast<std::uint32_t>(scene.textures.size()));
+    for (auto const & [key, texture] : scene.textures) {
+        writer.write_string(key);
+        writer.write(static_cast<std::uint32_t>(texture.levels.size()));
+        for (auto const & level : texture.levels) {
+            writer.write(level.width);
+            writer.write(level.height);
+            writer.write_blob({reinterpret_cast<char const *>(level.pixels.data()), level.pixels.size()});
+        }
+    }
+
+    pack_header header{};
+    std::memcpy(header.magic, pack_magic, sizeof(pack_magic));
+    header.version = pack_version;
+    header.source_hash = source_hash(source_path);
+    header.metadata_size = writer.metadata.size();
+    header.blob_offset = align_up(sizeof(header) + writer.metadata.size());
+
+    // Write to a temporary file first, so a running instance never maps a half-written pack
+    auto temporary_path = pack_path;
+    temporary_path += ".tmp";
+    {
+        std::ofstream output(temporary_path, std::ios::binary | std::ios::trunc);
+        output.write(reinterpret_cast<char const *>(&header), sizeof(header));
+        output.write(writer.metadata.data(), writer.metadata.size());
+        std::vector<char> padding(header.blob_offset - sizeof(header) - writer.metadata.size());
+        output.write(padding.data(), padding.size());
+        output.write(writer.blobs.data(), writer.blobs.size());
+        if (!output)
+            throw std::runtime_error("Failed to write " + temporary_path.string());
+    }
+    std::filesystem::rename(temporary_path, pack_path);
+}
+
+std::optional<baked_scene> load_scene_pack(std::filesystem::path const & pack_path, std::filesystem::path const & source_path)
+{
+    if (!std::filesystem::exists(pack_path))
+        return std::nullopt;
+
+    auto file = std::make_shared<mapped_file>(pack_path);
+    auto const data = file->data();
+
+    pack_header header;
+    if (data.size() < sizeof(header))
+        return std::nullopt;
+    std::memcpy(&header, data.data(), sizeof(header));
+    if (std::memcmp(header.magic, pack_magic, sizeof(pack_magic)) != 0 || header.version != pack_version)
+        return std::nullopt;
+    if (sizeof(header) + header.metadata_size > data.size() || header.blob_offset > data.size())
+        return std::nullopt;
+    if (header.source_hash != source_hash(source_path))
+        return std::nullopt;
+
+    pack_reader reader{data.subspan(sizeof(header), header.metadata_size), data.subspan(header.blob_offset)};
+
+    baked_scene result;
+    auto & model = result.model;
+    model.storage.push_back(file);
+
+    try {
+        model.buffers.resize(reader.read<std::uint32_t>());
+        for (auto & buffer : model.buffers)
+            buffer = reader.read_blob();
+
+        model.meshes.resize(reader.read<std::uint32_t>());
+        for (auto & mesh : model.meshes) {
+            mesh.name = reader.read_string();
+
+            auto & material = mesh.material;
+            material.two_sided = reader.read<bool>();
+            material.transparent = reader.read<bool>();
+            if (reader.read<bool>())
+                material.texture_path = reader.read_string();
+            if (reader.read<bool>())
+                material.texture_view = reader.read<gltf_model::buffer_view>();
+            if (reader.read<bool>())
+                material.color = reader.read<glm::vec4>();
+            material.metallicFactor = reader.read<float>();
+            material.roughnessFactor = reader.read<float>();
+
+            mesh.indices = reader.read<gltf_model::accessor>();
+            mesh.position = reader.read<gltf_model::accessor>();
+            mesh.normal = reader.read<gltf_model::accessor>();
+            mesh.texcoord = reader.read<gltf_model::accessor>();
+            mesh.min = reader.read<glm::vec3>();
+            mesh.max = reader.read<glm::vec3>();
+            mesh.is_rigged = reader.read<bool>();
+            mesh.joints = reader.read<gltf_model::accessor>();
+            mesh.weights = reader.read<gltf_model::accessor>();
+        }
+
+        model.bones.resize(reader.read<std::uint32_t>());
+        for (auto & bone : model.bones) {
+            bone.parent = reader.read<unsigned int>();
+            bone.name = reader.read_string();
+            bone.inverse_bind_matrix = reader.read<glm::mat4>();
+        }
+
+        auto const animation_count = reader.read<std::uint32_t>();
+        for (std::uint32_t i = 0; i < animation_count; ++i) {
+            auto & animation = model.animations[reader.read_string()];
+            animation.max_time = reader.read<float>();
+            animation.bones.resize(reader.read<std::uint32_t>());
+            for (auto & bone : animation.bones) {
+                reader.read_keys(model, bone.translation.timestamps);
+                reader.read_keys(model, bone.translation.values);
+                reader.read_keys(model, bone.rotation.timestamps);
+                reader.read_keys(model, bone.rotation.values);
+                reader.read_keys(model, bone.scale.timestamps);
+                reader.read_keys(model, bone.scale.values);
+            }
+        }
+
+        auto const texture_count = reader.read<std::uint32_t>();
+        for (std::uint32_t i = 0; i < texture_count; ++i) {
+            auto & texture = result.textures[reader.read_string()];
+            texture.storage = file;
+            texture.levels.resize(reader.read<std::uint32_t>());
+            for (auto & level : texture.levels) {
+                level.width = reader.read<int>();
+                level.height = reader.read<int>();
+                auto const pixels = reader.read_blob();
+                level.pixels = {reinterpret_cast<unsigned char const *>(pixels.data()), pixels.size()};
+            }
+        }
+
+        // A pack only exists for a source that loaded, but its skeleton is read back from a file that may have
+        // been damaged since; a failing pack is baked again, and the source then reports the error
+        check_skeleton(model, pack_path.string());
+    } catch (std::runtime_error const &) {
+        return std::nullopt;
+    }
+
+    return result;
+}
+
+std::filesystem::path scene_pack_path(std::filesystem::path const & source_path)
+{
+    auto result = source_path;
+    result += ".pack";
+    return result;
+}
+
+baked_scene load_scene(std::filesystem::path const & source_path)
+{
+    auto const pack_path = scene_pack_path(source_path);
+    if (auto scene = load_scene_pack(pack_path, source_path))
+        return std::move(*scene);
+
+    auto scene = bake_scene(source_path);
+    try {
+        save_scene_pack(scene, source_path, pack_path);
+    } catch (std::exception const & e) {
+        std::cerr << "Failed to save scene pack: " << e.what() << std::endl;
+    }
+    return scene;
+}
+
+namespace
+{
+
+struct loaded_scene
+{
+    baked_scene scene;
+    bool from_pack;
+};
+
+}
+
+// Loads fresh packs, or parses the models without their textures, in parallel
+static std::vector<loaded_scene> load_models(std::vector<std::filesystem::path> const & source_paths, thread_pool & pool)
+{
+    std::vector<std::future<loaded_scene>> loading;
+    for (auto const & source_path : source_paths)
+        loading.push_back(pool.submit([source_path]{
+            if (auto scene = load_scene_pack(scene_pack_path(source_path), source_path))
+                return loaded_scene{std::move(*scene), true};
+            return loaded_scene{{load_gltf(source_path)}, false};
+        }));
+
+    std::vector<loaded_scene> result;
+    for (auto & future : loading)
+        result.push_back(future.get());
+    return result;
+}
+
+static void save_scene_pack_logged(baked_scene const & scene, std::filesystem::path const & source_path)
+{
+    try {
+        save_scene_pack(scene, source_path, scene_pack_path(source_path));
+    } catch (std::exception const & e) {
+        std::cerr << "Failed to save scene pack: " << e.what() << std::endl;
+    }
+}
+
+std::vector<baked_scene> load_scenes(std::vector<std::filesystem::path> const & source_paths, thread_pool & pool)
+{
+    std::vector<baked_scene> result;
+    std::vector<bool> from_pack;
+    for (auto & loaded : load_models(source_paths, pool)) {
+        result.push_back(std::move(loaded.scene));
+        from_pack.push_back(loaded.from_pack);
+    }
+
+    // One task per image of every model that came from its source; the map entries are created
+    // up front so the workers only ever write into their own texture
+    std::vector<std::future<void>> decoding;
+    for (std::size_t i = 0; i < result.size(); ++i) {
+        if (from_pack[i])
+            continue;
+        for (auto const * material : texture_materials(result[i].model)) {
+            auto & texture = result[i].textures[*material->texture_path];
+            decoding.push_back(pool.submit([&model = result[i].model, &source_path = source_paths[i], material, &texture]{
+                texture = bake_texture(model, source_path, *material);
+            }));
+        }
+    }
+    // Everything has to finish before a failure is rethrown, the tasks reference `result`
+    for (auto & future : decoding)
+        future.wait();
+    for (auto & future : decoding)
+        future.get();
+
+    for (std::size_t i = 0; i < result.size(); ++i) {
+        if (from_pack[i])
+            continue;
+        pool.submit([scene = result[i], source_path = source_paths[i]]{
+            save_scene_pack_logged(scene, source_path);
+        });
+    }
+
+    return result;
+}
+
+std::vector<baked_scene> load_scenes(std::vector<std::filesystem::path> const & source_paths, thread_pool & pool,
+                                     texture_callback const & texture_ready)
+{
+    // Shared by the decoding tasks of one model; the last one to finish saves the pack
+    struct pending_pack
+    {
+        baked_scene scene;
+        std::filesystem::path source_path;
+        std::atomic<std::size_t> remaining;
+        std::atomic<bool> failed = false;
+    };
+
+    std::vector<baked_scene> result;
+    for (auto & loaded : load_models(source_paths, pool)) {
+        auto const index = result.size();
+        result.push_back(std::move(loaded.scene));
+        if (loaded.from_pack)
+            continue;
+
+        // The tasks work on their own copy of the model, which shares the buffers with the returned one
+        auto pending = std::make_shared<pending_pack>(baked_scene{result.back().model}, source_paths[index]);
+        auto const materials = texture_materials(pending->scene.model);
+        pending->remaining = materials.size();
+        if (materials.empty()) {
+            pool.submit([pending]{ save_scene_pack_logged(pending->scene, pending->source_path); });
+            continue;
+        }
+
+        // Entries are created up front so the workers only ever write into their own texture
+        for (auto const * material : materials)
+            pending->scene.textures[*material->texture_path];
+
+        for (auto const * material : materials)
+            pool.submit([pending, material, index, texture_ready]{
+                auto & texture = pending->scene.textures.at(*material->texture_path);
+                try {
+                    texture = bake_texture(pending->scene.model, pending->source_path, *material);
+                    texture_ready(index, *material->texture_path, texture);
+                } catch (std::exception const & e) {
+                    std::cerr << "Failed to load texture " << *material->texture_path << ": " << e.what() << std::endl;
+                    pending->failed = true;
+                }
+                if (--pending->remaining == 0 && !pending->failed)
+                    save_scene_pack_logged(pending->scene, pending->source_path);
+            });
+    }
+
+    return result;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "gltf_loader.hpp"
+#include "texture_loader.hpp"
+#include "thread_pool.hpp"
+
+#include <filesystem>
+#include <functional>
+#include <optional>
+#include <string>
+#include <map>
+
+// A fully resolved model together with its decoded textures, the contents of a scene pack
+struct baked_scene
+{
+    gltf_model model;
+    // Keyed by material::texture_path
+    std::map<std::string, texture_data> textures;
+};
+
+// Loads a glTF model and decodes its textures with complete mip chains
+baked_scene bake_scene(std::filesystem::path const & source_path);
+
+void save_scene_pack(baked_scene const & scene, std::filesystem::path const & source_path, std::filesystem::path const & pack_path);
+
+// Maps a pack with a single mmap; returns nothing if the pack is missing, of another version or stale
+std::optional<baked_scene> load_scene_pack(std::filesystem::path const & pack_path, std::filesystem::path const & source_path);
+
+std::filesystem::path scene_pack_path(std::filesystem::path const & source_path);
+
+// Loads the pack next to a model, rebaking it first when it is missing or stale
+baked_scene load_scene(std::filesystem::path const & source_path);
+
+// Same as load_scene for several models at once: models are parsed and textures decoded in parallel
+// on the pool, stale packs are rewritten in the background
+std::vector<baked_scene> load_scenes(std::vector<std::filesystem::path> const & source_paths, thread_pool & pool);
+
+using texture_callback = std::function<void(std::size_t scene, std::string const & key, texture_data const & texture)>;
+
+// Progressive variant of load_scenes: returns as soon as the models are loaded. Textures of fresh packs are
+// already in the result; the others are decoded on the pool and passed to `texture_ready` on the worker
+// that finished them, so whatever it references must outlive the pool. Stale packs are rewritten once
+// all textures of their model are decoded.
+std::vector<baked_scene> load_scenes(std::vector<std::filesystem::path> const & source_paths, thread_pool & pool,
+                                     texture_callback const & texture_ready);
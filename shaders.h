@@ -2,15 +2,82 @@
 
 #include <GL/glew.h>
 
+// Skinning shared by the vertex shaders, compiled on its own and linked into each program that declares
+// skinning_matrix
+const char skinning_shader_source[] =
+        R"(#version 330 core
+
+// Bones of rigged draws, see bone_palette_ring: instances have palette_bone_count bones each from the texel
+// palette_offset on, as matrices of three texels or as dual quaternions of two
+uniform samplerBuffer bone_palette;
+uniform int palette_offset;
+uniform int palette_bone_count;
+uniform int dual_quaternion_skinning;
+
+vec4 bone_texel(int joint, int index)
+{
+    int texels_per_bone = dual_quaternion_skinning != 0 ? 2 : 3;
+    return texelFetch(bone_palette, palette_offset + (gl_InstanceID * palette_bone_count + joint) * texels_per_bone + index);
+}
+
+mat4x3 skinning_matrix(ivec4 joints, vec4 weights)
+{
+    if (dual_quaternion_skinning != 0) {
+        // Blended in the hemisphere of the first joint, normalized and turned back into a rigid transform
+        vec4 pivot = bone_texel(joints[0], 0);
+        vec4 real = vec4(0);
+        vec4 dual = vec4(0);
+        for (int i = 0; i < 4; ++i) {
+            vec4 joint_real = bone_texel(joints[i], 0);
+            float weight = dot(joint_real, pivot) < 0.0 ? -weights[i] : weights[i];
+            real += weight * joint_real;
+            dual += weight * bone_texel(joints[i], 1);
+        }
+        float norm = length(real);
+        real /= norm;
+        dual /= norm;
+
+        vec3 q = real.xyz;
+        float w = real.w;
+        vec3 translation = 2.0 * (w * dual.xyz - dual.w * q + cross(q, dual.xyz));
+        return mat4x3(
+            vec3(1.0 - 2.0 * (q.y * q.y + q.z * q.z), 2.0 * (q.x * q.y + w * q.z), 2.0 * (q.x * q.z - w * q.y)),
+            vec3(2.0 * (q.x * q.y - w * q.z), 1.0 - 2.0 * (q.x * q.x + q.z * q.z), 2.0 * (q.y * q.z + w * q.x)),
+            vec3(2.0 * (q.x * q.z + w * q.y), 2.0 * (q.y * q.z - w * q.x), 1.0 - 2.0 * (q.x * q.x + q.y * q.y)),
+            translation);
+    }
+
+    mat4x3 average = mat4x3(0);
+    float sum = 0;
+    for (int i = 0; i < 4; ++i) {        //was 4
+        vec4 a = bone_texel(joints[i], 0);
+        vec4 b = bone_texel(joints[i], 1);
+        vec4 c = bone_texel(joints[i], 2);
+        sum += weights[i];
+        average += weights[i] * mat4x3(a.xyz, vec3(a.w, b.xy), vec3(b.zw, c.x), c.yzw);
+    }
+    return average / sum;
+}
+)";
+
 const char vertex_shader_source[] =
         R"(#version 330 core
 
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
-uniform mat4x3 bones[64];
 uniform int is_rigged;
 uniform int is_instance;
+// Instances playing a vertex_animation instead of being skinned, at `time` plus their own offset
+uniform int use_vertex_animation;
+uniform sampler2D vertex_animation_positions;
+uniform sampler2D vertex_animation_normals;
+uniform int vertex_animation_vertex_count;
+uniform int vertex_animation_frame_count;
+uniform float vertex_animation_frame_rate;
+uniform float vertex_animation_duration;
+uniform int vertex_animation_base_vertex;
+uniform float time;
 
 layout (location = 0) in vec3 in_position;
 layout (location = 1) in vec3 in_normal;
@@ -18,6 +85,7 @@ layout (location = 2) in vec2 in_texcoord;
 layout (location = 3) in ivec4 in_joints;
 layout (location = 4) in vec4 in_weights;
 layout (location = 5) in vec3 instance; //TODO add
+layout (location = 6) in float instance_time;
 uniform mat4 instance_turn;
 
 out vec3 normal;
@@ -25,15 +93,41 @@ out vec2 texcoord;
 out vec4 weights;
 out vec3 position;
 
+mat4x3 skinning_matrix(ivec4 joints, vec4 weights);
+
+vec3 vertex_animation_texel(sampler2D frames, int frame)
+{
+    int texel = frame * vertex_animation_vertex_count + gl_VertexID - vertex_animation_base_vertex;
+    int width = textureSize(frames, 0).x;
+    return texelFetch(frames, ivec2(texel % width, texel / width), 0).xyz;
+}
+
 void main()
 {
-    mat4x3 average = mat4x3(0);
-    float sum = 0;
-    for (int i = 0; i < 4; ++i) {        //was 4
-        sum += in_weights[i];
-        average += in_weights[i] * bones[in_joints[i]];
+    if (use_vertex_animation != 0) {
+        float frame_time = mod(time + instance_time, vertex_animation_duration);
+        int first = min(int(frame_time * vertex_animation_frame_rate), vertex_animation_frame_count - 1);
+        int second = min(first + 1, vertex_animation_frame_count - 1);
+        float first_time = first / vertex_animation_frame_rate;
+        float second_time = min(second / vertex_animation_frame_rate, vertex_animation_duration);
+        float t = second_time > first_time ? (frame_time - first_time) / (second_time - first_time) : 0.0;
+
+        vec3 animated_position = mix(vertex_animation_texel(vertex_animation_positions, first),
+                                     vertex_animation_texel(vertex_animation_positions, second), t);
+        vec3 animated_normal = mix(vertex_animation_texel(vertex_animation_normals, first),
+                                   vertex_animation_texel(vertex_animation_normals, second), t);
+
+        gl_Position = projection * view * model * vec4(animated_position + instance, 1.0);
+        normal = mat3(model) * animated_normal;
+        position = (model * vec4(animated_position, 1.0)).xyz;
+        weights = in_weights;
+        texcoord = in_texcoord;
+        return;
     }
-    average /= sum;
+
+    mat4x3 average = mat4x3(0);
+    if (is_rigged != 0)
+        average = skinning_matrix(in_joints, in_weights);
     vec3 new_instance;
     mat4 new_instance_turn;
     if (is_instance == 0) {
@@ -53,7 +147,7 @@ void main()
                                 -new_instance.x, -new_instance.y, -new_instance.z, 1 );
     mat4 new_view = view * shift_view * new_instance_turn * inv_shift_view;
     if (is_rigged != 0) {
-        gl_Position = projection * new_view * model * mat4(average) * vec4(in_position + new_instance, 1.0);
+        gl_Position = projection * new_view * model * (mat4(average) * vec4(in_position, 1.0) + vec4(new_instance, 0.0));
         normal = mat3(model) * mat3(average) * in_normal;
     } else {
         gl_Position = projection * new_view * model * vec4(in_position + new_instance, 1.0);
@@ -65,6 +159,28 @@ void main()
 }
 )";
 
+// Skins the vertices of a rigged mesh into transform feedback buffers, see skinned_mesh_cache
+const char vertex_shader_skinning_source[] =
+        R"(#version 330 core
+
+layout (location = 0) in vec3 in_position;
+layout (location = 1) in vec3 in_normal;
+layout (location = 3) in ivec4 in_joints;
+layout (location = 4) in vec4 in_weights;
+
+out vec3 skinned_position;
+out vec3 skinned_normal;
+
+mat4x3 skinning_matrix(ivec4 joints, vec4 weights);
+
+void main()
+{
+    mat4x3 skin = skinning_matrix(in_joints, in_weights);
+    skinned_position = skin * vec4(in_position, 1.0);
+    skinned_normal = mat3(skin) * in_normal;
+}
+)";
+
 const char fragment_shader_source[] =
         R"(#version 330 core
 
@@ -0,0 +1,103 @@
+#include "skeleton.hpp"
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define SKELETON_SSE
+#endif
+
+affine_matrix affine_transform(glm::vec3 const & translation, glm::quat const & rotation, glm::vec3 const & scale)
+{
+    float const x = rotation.x, y = rotation.y, z = rotation.z, w = rotation.w;
+    return {{
+        glm::vec4((1.f - 2.f * (y * y + z * z)) * scale.x, 2.f * (x * y - w * z) * scale.y, 2.f * (x * z + w * y) * scale.z, translation.x),
+        glm::vec4(2.f * (x * y + w * z) * scale.x, (1.f - 2.f * (x * x + z * z)) * scale.y, 2.f * (y * z - w * x) * scale.z, translation.y),
+        glm::vec4(2.f * (x * z - w * y) * scale.x, 2.f * (y * z + w * x) * scale.y, (1.f - 2.f * (x * x + y * y)) * scale.z, translation.z),
+    }};
+}
+
+affine_matrix affine_transform(glm::mat4 const & matrix)
+{
+    return {{
+        glm::vec4(matrix[0][0], matrix[1][0], matrix[2][0], matrix[3][0]),
+        glm::vec4(matrix[0][1], matrix[1][1], matrix[2][1], matrix[3][1]),
+        glm::vec4(matrix[0][2], matrix[1][2], matrix[2][2], matrix[3][2]),
+    }};
+}
+
+affine_matrix affine_multiply(affine_matrix const & a, affine_matrix const & b)
+{
+    affine_matrix result;
+#ifdef SKELETON_SSE
+    // Every row of the result is a combination of the rows of `b` and of 0 0 0 1
+    __m128 const b0 = _mm_loadu_ps(&b.rows[0].x);
+    __m128 const b1 = _mm_loadu_ps(&b.rows[1].x);
+    __m128 const b2 = _mm_loadu_ps(&b.rows[2].x);
+    __m128 const b3 = _mm_set_ps(1.f, 0.f, 0.f, 0.f);
+    for (std::size_t i = 0; i < 3; ++i) {
+        __m128 const row = _mm_loadu_ps(&a.rows[i].x);
+        __m128 sum = _mm_mul_ps(_mm_shuffle_ps(row, row, _MM_SHUFFLE(0, 0, 0, 0)), b0);
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_shuffle_ps(row, row, _MM_SHUFFLE(1, 1, 1, 1)), b1));
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_shuffle_ps(row, row, _MM_SHUFFLE(2, 2, 2, 2)), b2));
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_shuffle_ps(row, row, _MM_SHUFFLE(3, 3, 3, 3)), b3));
+        _mm_storeu_ps(&result.rows[i].x, sum);
+    }
+#else
+    for (std::size_t i = 0; i < 3; ++i) {
+        auto const & row = a.rows[i];
+        result.rows[i] = row.x * b.rows[0] + row.y * b.rows[1] + row.z * b.rows[2] + glm::vec4(0.f, 0.f, 0.f, row.w);
+    }
+#endif
+    return result;
+}
+
+glm::mat4x3 to_mat4x3(affine_matrix const & matrix)
+{
+    auto const & [x, y, z] = matrix.rows;
+    return glm::mat4x3(x.x, y.x, z.x, x.y, y.y, z.y, x.z, y.z, z.z, x.w, y.w, z.w);
+}
+
+skeleton_lod::skeleton_lod(std::span<gltf_model::bone const> bones, std::size_t max_depth, local_pose const & rest)
+    : evaluated(bones.size())
+    , rest(bones.size())
+{
+    std::vector<std::size_t> depths(bones.size());
+    for (std::size_t i = 0; i < bones.size(); ++i) {
+        auto parent = bones[i].parent;
+        depths[i] = parent != gltf_model::bone::no_parent ? depths[parent] + 1 : 0;
+        evaluated[i] = depths[i] <= max_depth;
+        if (evaluated[i])
+            this->bones.push_back(i);
+
+        this->rest[i] = affine_transform(rest.translations[i], rest.rotations[i], rest.scales[i]);
+    }
+}
+
+skeleton_instance::skeleton_instance(std::span<gltf_model::bone const> bones)
+    : transforms(bones.size())
+    , parents(bones.size())
+    , inverse_bind_matrices(bones.size())
+{
+    for (std::size_t i = 0; i < bones.size(); ++i) {
+        parents[i] = bones[i].parent;
+        inverse_bind_matrices[i] = affine_transform(bones[i].inverse_bind_matrix);
+    }
+}
+
+void skeleton_instance::update(local_pose const & pose, std::span<glm::mat4x3> palette)
+{
+    for (std::size_t i = 0; i < parents.size(); ++i) {
+        auto transform = affine_transform(pose.translations[i], pose.rotations[i], pose.scales[i]);
+        transforms[i] = parents[i] != gltf_model::bone::no_parent ? affine_multiply(transforms[parents[i]], transform) : transform;
+        palette[i] = to_mat4x3(affine_multiply(transforms[i], inverse_bind_matrices[i]));
+    }
+}
+
+void skeleton_instance::update(local_pose const & pose, skeleton_lod const & lod, std::span<glm::mat4x3> palette)
+{
+    for (std::size_t i = 0; i < parents.size(); ++i) {
+        auto transform = lod.evaluated[i] ? affine_transform(pose.translations[i], pose.rotations[i], pose.scales[i])
+            : lod.rest[i];
+        transforms[i] = parents[i] != gltf_model::bone::no_parent ? affine_multiply(transforms[parents[i]], transform) : transform;
+        palette[i] = to_mat4x3(affine_multiply(transforms[i], inverse_bind_matrices[i]));
+    }
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "animation_graph.hpp"
+
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat4x3.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <array>
+#include <cstddef>
+#include <span>
+#include <vector>
+
+// An affine transform as the top three rows of its matrix, the bottom row being 0 0 0 1. Composing two costs
+// 36 multiplications instead of the 64 of a 4x4 product, and each row fits one SSE register.
+struct affine_matrix
+{
+    std::array<glm::vec4, 3> rows;
+};
+
+// The transform scaling, then rotating, then translating
+affine_matrix affine_transform(glm::vec3 const & translation, glm::quat const & rotation, glm::vec3 const & scale);
+// The top three rows of `matrix`
+affine_matrix affine_transform(glm::mat4 const & matrix);
+// Product of two affine transforms, `b` applied first
+affine_matrix affine_multiply(affine_matrix const & a, affine_matrix const & b);
+glm::mat4x3 to_mat4x3(affine_matrix const & matrix);
+
+// Bones of a skeleton evaluated at a level of detail: bones deeper than `max_depth` below a root, such as
+// feathers or fingers, aren't sampled nor blended and keep their transform in `rest` relative to their parent
+struct skeleton_lod
+{
+    skeleton_lod(std::span<gltf_model::bone const> bones, std::size_t max_depth, local_pose const & rest);
+
+    // Evaluated bones in skeleton order, to pass to animation_graph::evaluate
+    std::vector<std::size_t> bones;
+    std::vector<bool> evaluated;
+    std::vector<affine_matrix> rest;
+};
+
+// Model space transforms of one posed skeleton, allocated once, so posing a character allocates nothing
+struct skeleton_instance
+{
+    // Parents must precede their children
+    explicit skeleton_instance(std::span<gltf_model::bone const> bones);
+
+    // Composes `pose` down the hierarchy and writes the skinning matrices, model transforms times inverse
+    // bind matrices, into `palette`
+    void update(local_pose const & pose, std::span<glm::mat4x3> palette);
+    // Same, with the bones `lod` doesn't evaluate in their rest transforms
+    void update(local_pose const & pose, skeleton_lod const & lod, std::span<glm::mat4x3> palette);
+
+    std::vector<affine_matrix> transforms;
+
+private:
+    std::vector<unsigned int> parents;
+    std::vector<affine_matrix> inverse_bind_matrices;
+};
@@ -0,0 +1,97 @@
+#include "skinned_mesh_cache.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <map>
+
+skinned_mesh_cache::skinned_mesh_cache(geometry_arena const & arena, std::span<geometry_arena::draw_range const> meshes)
+    : ranges(meshes.begin(), meshes.end())
+    , meshes(meshes)
+    , offsets(meshes.size())
+{
+    // Meshes are stored per arena layout in the same order as in the arena, so that a vertex array per layout
+    // reads the skinned vertices and the arena texture coordinates at the same base vertex
+    struct layout_span
+    {
+        GLint first = std::numeric_limits<GLint>::max();
+        GLint last = 0;
+        std::size_t offset = 0;
+    };
+    std::map<std::size_t, layout_span> layouts;
+    for (auto const & mesh : meshes) {
+        auto & span = layouts[mesh.layout];
+        span.first = std::min(span.first, mesh.base_vertex);
+        span.last = std::max(span.last, mesh.base_vertex + mesh.vertex_count);
+    }
+
+    std::size_t size = 0;
+    for (auto & [layout, span] : layouts) {
+        span.offset = size;
+        size += (span.last - span.first) * vertex_size;
+    }
+
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glBufferData(GL_ARRAY_BUFFER, size, nullptr, GL_DYNAMIC_COPY);
+
+    std::map<std::size_t, GLuint> layout_vaos;
+    for (auto const & [layout, span] : layouts) {
+        auto const & arena_layout = arena.layouts[layout];
+        GLuint vao;
+        glGenVertexArrays(1, &vao);
+        glBindVertexArray(vao);
+        vaos.push_back(vao);
+        layout_vaos[layout] = vao;
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, arena.index_buffer);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, vertex_size, reinterpret_cast<void *>(span.offset));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, vertex_size, reinterpret_cast<void *>(span.offset + 3 * sizeof(float)));
+
+        auto const & texcoord = arena_layout.format[2];
+        if (texcoord.type != 0) {
+            auto const stride = arena_layout.strides[2];
+            glBindBuffer(GL_ARRAY_BUFFER, arena.vertex_buffer);
+            glEnableVertexAttribArray(2);
+            glVertexAttribPointer(2, texcoord.size, texcoord.type, texcoord.normalized ? GL_TRUE : GL_FALSE, stride,
+                reinterpret_cast<void *>(arena_layout.offsets[2] + span.first * stride));
+        }
+    }
+    glBindVertexArray(0);
+
+    for (std::size_t i = 0; i < meshes.size(); ++i) {
+        auto const & span = layouts[meshes[i].layout];
+        offsets[i] = span.offset + (meshes[i].base_vertex - span.first) * vertex_size;
+        ranges[i].vao = layout_vaos[meshes[i].layout];
+        ranges[i].base_vertex = meshes[i].base_vertex - span.first;
+        ranges[i].resident = false;
+    }
+}
+
+skinned_mesh_cache::~skinned_mesh_cache()
+{
+    glDeleteVertexArrays(vaos.size(), vaos.data());
+    glDeleteBuffers(1, &buffer);
+}
+
+void skinned_mesh_cache::skin()
+{
+    // Only the captured vertices are wanted, nothing is rasterized
+    glEnable(GL_RASTERIZER_DISCARD);
+    for (std::size_t i = 0; i < meshes.size(); ++i) {
+        auto const & mesh = meshes[i];
+        if (!mesh.resident)
+            continue;
+
+        glBindVertexArray(mesh.vao);
+        glBindBufferRange(GL_TRANSFORM_FEEDBACK_BUFFER, 0, buffer, offsets[i], mesh.vertex_count * vertex_size);
+        glBeginTransformFeedback(GL_POINTS);
+        glDrawArrays(GL_POINTS, mesh.base_vertex, mesh.vertex_count);
+        glEndTransformFeedback();
+        ranges[i].resident = true;
+    }
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    glDisable(GL_RASTERIZER_DISCARD);
+}
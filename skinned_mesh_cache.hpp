@@ -0,0 +1,39 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <cstddef>
+#include <span>
+#include <vector>
+
+#include "geometry_arena.hpp"
+
+// Rigged meshes skinned once per frame into a buffer of model space positions and normals by transform
+// feedback, so that the passes drawing them afterwards read them as static geometry instead of skinning
+// every vertex again in each pass.
+struct skinned_mesh_cache
+{
+    // Position and normal of a vertex, as captured from vertex_shader_skinning_source
+    static constexpr std::size_t vertex_size = 6 * sizeof(float);
+
+    // Skinned copies of the arena ranges `meshes`, which must stay alive as long as the cache
+    skinned_mesh_cache(geometry_arena const & arena, std::span<geometry_arena::draw_range const> meshes);
+    ~skinned_mesh_cache();
+
+    skinned_mesh_cache(skinned_mesh_cache const &) = delete;
+    skinned_mesh_cache & operator = (skinned_mesh_cache const &) = delete;
+
+    // Skins every resident mesh; the skinning program must be in use with its bone palette set up
+    void skin();
+
+    // Draw ranges of the skinned meshes in the order of `meshes`, resident once skinned. Texture coordinates
+    // and indices are still read from the arena.
+    std::vector<geometry_arena::draw_range> ranges;
+
+private:
+    std::span<geometry_arena::draw_range const> meshes;
+    // Byte offset of each skinned mesh in the buffer
+    std::vector<std::size_t> offsets;
+    GLuint buffer = 0;
+    std::vector<GLuint> vaos;
+};
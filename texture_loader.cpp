@@ -0,0 +1,80 @@
+#include "texture_loader.hpp"
+#include "stb_image.h"
+
+#include <stdexcept>
+#include <cstring>
+
+static texture_data make_texture_data(stbi_uc * pixels, int width, int height, std::string const & name)
+{
+    if (!pixels)
+        throw std::runtime_error("Failed to decode texture " + name + ": " + stbi_failure_reason());
+
+    texture_data result;
+    result.storage = std::shared_ptr<stbi_uc>(pixels, stbi_image_free);
+    result.levels.push_back({width, height, {pixels, std::size_t(width) * height * 4}});
+    return result;
+}
+
+texture_data load_texture_data(std::filesystem::path const & path)
+{
+    int width, height, channels;
+    auto pixels = stbi_load(path.string().c_str(), &width, &height, &channels, 4);
+    return make_texture_data(pixels, width, height, path.string());
+}
+
+texture_data load_texture_data(gltf_model const & model, std::filesystem::path const & model_path, gltf_model::material const & material)
+{
+    int width, height, channels;
+    if (auto const & view = material.texture_view) {
+        auto pixels = stbi_load_from_memory(reinterpret_cast<stbi_uc const *>(model.data(*view)), view->size, &width, &height, &channels, 4);
+        return make_texture_data(pixels, width, height, *material.texture_path);
+    }
+    return load_texture_data(model_path.parent_path() / *material.texture_path);
+}
+
+void generate_mipmaps(texture_data & texture)
+{
+    auto const base = texture.levels.at(0);
+
+    std::vector<texture_data::level> levels{{base.width, base.height, {}}};
+    std::size_t total_size = base.pixels.size();
+    while (levels.back().width > 1 || levels.back().height > 1) {
+        int width = std::max(1, levels.back().width / 2);
+        int height = std::max(1, levels.back().height / 2);
+        levels.push_back({width, height, {}});
+        total_size += std::size_t(width) * height * 4;
+    }
+
+    auto storage = std::make_shared<std::vector<unsigned char>>(total_size);
+    std::memcpy(storage->data(), base.pixels.data(), base.pixels.size());
+
+    unsigned char * data = storage->data();
+    levels[0].pixels = {data, base.pixels.size()};
+    data += base.pixels.size();
+
+    for (std::size_t l = 1; l < levels.size(); ++l) {
+        auto const & source = levels[l - 1];
+        auto & level = levels[l];
+        level.pixels = {data, std::size_t(level.width) * level.height * 4};
+
+        // 2x2 box filter, odd edges reuse the last row/column
+        for (int y = 0; y < level.height; ++y) {
+            int const y0 = std::min(2 * y, source.height - 1), y1 = std::min(2 * y + 1, source.height - 1);
+            for (int x = 0; x < level.width; ++x) {
+                int const x0 = std::min(2 * x, source.width - 1), x1 = std::min(2 * x + 1, source.width - 1);
+                for (int c = 0; c < 4; ++c) {
+                    unsigned int sum = source.pixels[(y0 * source.width + x0) * 4 + c]
+                                       + source.pixels[(y0 * source.width + x1) * 4 + c]
+                                       + source.pixels[(y1 * source.width + x0) * 4 + c]
+                                       + source.pixels[(y1 * source.width + x1) * 4 + c];
+                    data[(y * level.width + x) * 4 + c] = (sum + 2) / 4;
+                }
+            }
+        }
+
+        data += level.pixels.size();
+    }
+
+    texture.storage = std::move(storage);
+    texture.levels = std::move(levels);
+}
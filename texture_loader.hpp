@@ -0,0 +1,30 @@
+#pragma once
+
+#include "gltf_loader.hpp"
+
+#include <filesystem>
+#include <memory>
+#include <span>
+#include <vector>
+
+// RGBA8 image with its mip chain, level 0 is the full resolution
+struct texture_data
+{
+    struct level
+    {
+        int width;
+        int height;
+        std::span<unsigned char const> pixels;
+    };
+
+    std::shared_ptr<void const> storage;
+    std::vector<level> levels;
+};
+
+texture_data load_texture_data(std::filesystem::path const & path);
+
+// Decodes the base color image of a material, either from a file next to the model or from a model buffer
+texture_data load_texture_data(gltf_model const & model, std::filesystem::path const & model_path, gltf_model::material const & material);
+
+// Replaces the mip chain of a texture by box-filtered levels of its level 0, down to 1x1
+void generate_mipmaps(texture_data & texture);
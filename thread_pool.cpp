@@ -0,0 +1,34 @@
+#include "thread_pool.hpp"
+
+thread_pool::thread_pool(std::size_t thread_count)
+{
+    for (std::size_t i = 0; i < thread_count; ++i)
+        threads.emplace_back([this]{ run(); });
+}
+
+thread_pool::~thread_pool()
+{
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    condition.notify_all();
+    for (auto & thread : threads)
+        thread.join();
+}
+
+void thread_pool::run()
+{
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock lock(mutex);
+            condition.wait(lock, [this]{ return stopping || !tasks.empty(); });
+            if (tasks.empty())
+                return;
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+    }
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Fixed set of worker threads executing submitted tasks in FIFO order.
+// Tasks must not wait on other tasks of the same pool; the destructor finishes all pending tasks.
+struct thread_pool
+{
+    explicit thread_pool(std::size_t thread_count = std::max(1u, std::thread::hardware_concurrency()));
+    ~thread_pool();
+
+    thread_pool(thread_pool const &) = delete;
+    thread_pool & operator = (thread_pool const &) = delete;
+
+    template <typename F>
+    std::future<std::invoke_result_t<F>> submit(F && function)
+    {
+        auto task = std::make_shared<std::packaged_task<std::invoke_result_t<F>()>>(std::forward<F>(function));
+        auto result = task->get_future();
+        {
+            std::lock_guard lock(mutex);
+            tasks.emplace_back([task]{ (*task)(); });
+        }
+        condition.notify_one();
+        return result;
+    }
+
+    std::size_t size() const
+    {
+        return threads.size();
+    }
+
+private:
+    void run();
+
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::deque<std::function<void()>> tasks;
+    bool stopping = false;
+};
@@ -0,0 +1,32 @@
+#include "upload_queue.hpp"
+
+void upload_queue::push(std::function<void()> upload)
+{
+    std::lock_guard lock(mutex);
+    uploads.push_back(std::move(upload));
+}
+
+std::size_t upload_queue::run(std::chrono::duration<float, std::milli> budget)
+{
+    auto const start = std::chrono::steady_clock::now();
+    std::size_t count = 0;
+    do {
+        std::function<void()> upload;
+        {
+            std::lock_guard lock(mutex);
+            if (uploads.empty())
+                break;
+            upload = std::move(uploads.front());
+            uploads.pop_front();
+        }
+        upload();
+        ++count;
+    } while (std::chrono::steady_clock::now() - start < budget);
+    return count;
+}
+
+bool upload_queue::empty() const
+{
+    std::lock_guard lock(mutex);
+    return uploads.empty();
+}
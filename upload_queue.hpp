@@ -0,0 +1,23 @@
+#pragma once
+
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <mutex>
+
+// Work that has to run on the thread owning the GL context, queued from any thread (usually pool workers
+// that finished loading something) and run between frames. Uploads may queue further uploads.
+struct upload_queue
+{
+    void push(std::function<void()> upload);
+
+    // Runs queued uploads in FIFO order until the queue is empty or `budget` has passed; at least one
+    // runs if any is queued, so the queue always makes progress. Returns the number of uploads run.
+    std::size_t run(std::chrono::duration<float, std::milli> budget);
+
+    bool empty() const;
+
+private:
+    mutable std::mutex mutex;
+    std::deque<std::function<void()>> uploads;
+};
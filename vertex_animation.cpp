@@ -0,0 +1,61 @@
+#include "vertex_animation.hpp"
+#include "animation_graph.hpp"
+#include "skeleton.hpp"
+
+#include <glm/mat3x3.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+vertex_animation bake_vertex_animation(gltf_model const & model, gltf_model::mesh const & mesh,
+    gltf_model::animation const & animation, float frame_rate, std::size_t width)
+{
+    if (!mesh.is_rigged)
+        throw std::runtime_error("Vertex animation of a mesh without a skin: " + mesh.name);
+
+    vertex_animation result;
+    result.frame_rate = frame_rate;
+    result.duration = animation.max_time;
+    result.vertex_count = mesh.position.count;
+    result.frame_count = static_cast<std::size_t>(std::ceil(animation.max_time * frame_rate)) + 1;
+    result.width = width;
+    result.height = (result.frame_count * result.vertex_count + width - 1) / width;
+    result.positions.resize(result.width * result.height);
+    result.normals.resize(result.width * result.height);
+
+    auto const positions = read_accessor(model, mesh.position);
+    auto const normals = read_accessor(model, mesh.normal);
+    auto const joints = read_accessor(model, mesh.joints);
+    auto const weights = read_accessor(model, mesh.weights);
+
+    local_pose pose(model.bones.size());
+    skeleton_instance skeleton(model.bones);
+    std::vector<glm::mat4x3> palette(model.bones.size());
+
+    for (std::size_t frame = 0; frame < result.frame_count; ++frame) {
+        sample_animation(animation, std::min(frame / frame_rate, animation.max_time), pose);
+        skeleton.update(pose, palette);
+
+        // Same blend as the vertex shader, weights normalized by their sum
+        for (std::size_t vertex = 0; vertex < result.vertex_count; ++vertex) {
+            glm::mat4x3 skin(0.f);
+            float sum = 0.f;
+            for (std::size_t i = 0; i < 4; ++i) {
+                float weight = weights[vertex * 4 + i];
+                skin += weight * palette[static_cast<std::size_t>(joints[vertex * 4 + i])];
+                sum += weight;
+            }
+            skin /= sum;
+
+            glm::vec3 position(positions[vertex * 3], positions[vertex * 3 + 1], positions[vertex * 3 + 2]);
+            glm::vec3 normal(normals[vertex * 3], normals[vertex * 3 + 1], normals[vertex * 3 + 2]);
+
+            auto const texel = frame * result.vertex_count + vertex;
+            result.positions[texel] = glm::vec4(skin * glm::vec4(position, 1.f), 1.f);
+            result.normals[texel] = glm::vec4(glm::normalize(glm::mat3(skin) * normal), 0.f);
+        }
+    }
+
+    return result;
+}
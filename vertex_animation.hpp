@@ -0,0 +1,29 @@
+#pragma once
+
+#include "gltf_loader.hpp"
+
+#include <glm/vec4.hpp>
+
+#include <cstddef>
+#include <vector>
+
+// A skinned mesh pre-skinned for every frame of an animation, for playing it back without evaluating poses.
+// Texels are model space positions and normals, frame after frame of vertex_count texels each, wrapped into
+// rows of `width` texels so that long animations of big meshes still fit a texture.
+struct vertex_animation
+{
+    float frame_rate = 0.f;
+    float duration = 0.f;
+    std::size_t vertex_count = 0;
+    // Frames are at multiples of 1 / frame_rate, the last one at `duration`
+    std::size_t frame_count = 0;
+
+    std::size_t width = 0;
+    std::size_t height = 0;
+    // width * height texels each, the w components are unused
+    std::vector<glm::vec4> positions;
+    std::vector<glm::vec4> normals;
+};
+
+vertex_animation bake_vertex_animation(gltf_model const & model, gltf_model::mesh const & mesh,
+    gltf_model::animation const & animation, float frame_rate, std::size_t width = 1024);